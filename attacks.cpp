@@ -0,0 +1,100 @@
+#include "attacks.hpp"
+#include <cassert>
+#include <vector>
+
+std::array<sliding_attack_table, SQUARES_COUNT> rook_tables, bishop_tables;
+
+namespace {
+
+std::vector<bitboard> rook_attack_storage, bishop_attack_storage;
+
+bitboard relevant_occupancy(int square, const std::array<int, 4> &directions) {
+	bitboard ret = 0;
+	for (int d : directions) {
+		bitboard ray = rays[d][square];
+		if (!ray) continue;
+		int last = d < 4 ? 63 - __builtin_clzll(ray) : __builtin_ctzll(ray);
+		ret |= ray & ~(bitboard(1) << last);
+	}
+	return ret;
+}
+
+std::vector<bitboard> subsets_of(bitboard mask) {
+	std::vector<bitboard> ret;
+	bitboard subset = 0;
+	do {
+		ret.push_back(subset);
+		subset = (subset - mask) & mask;
+	} while (subset);
+	return ret;
+}
+
+//Found by trying sparse candidates (and of 3 splitmix64 outputs) until there are no destructive collisions, fixed shift of 64 - popcount(mask)
+constexpr std::array<bitboard, SQUARES_COUNT> rook_magics = {
+	0x0080011180400060ull, 0x0440044060041004ull, 0x82001008c2802200ull, 0x4500090421005000ull,
+	0x0100080004100300ull, 0x120008c2000c0110ull, 0x0080218002000100ull, 0xc080004080023100ull,
+	0x1104800260400280ull, 0x0000400420100040ull, 0x0042808010002000ull, 0x0002800800300182ull,
+	0x0828802800802400ull, 0x0086000802001451ull, 0x8041000482000100ull, 0x1000800047000880ull,
+	0x0080024000200441ull, 0x820040c00020100aull, 0x8910010100200040ull, 0x0c20620040100a00ull,
+	0x0208008080080400ull, 0x0080808004000200ull, 0x0000808003001200ull, 0x0000260000812044ull,
+	0x1040014880008820ull, 0xc00f400040201003ull, 0x0900200180100081ull, 0x1009001900100120ull,
+	0x0802010e00102008ull, 0xd205000900220400ull, 0x00c01a2c00081011ull, 0x0200029200041041ull,
+	0x000a400082800030ull, 0x424002d101002080ull, 0x0640801000802009ull, 0x2880801000802800ull,
+	0x091c000480801801ull, 0x0010800200800400ull, 0x8001012804001210ull, 0x0085002081000042ull,
+	0x4003628140008000ull, 0x80a0022050004008ull, 0x1020820020120040ull, 0x8000100018008080ull,
+	0x1403001048010004ull, 0x0008440002008080ull, 0x40000250080400a1ull, 0x0201918041020004ull,
+	0x8000c00038800080ull, 0x406084c10a08a200ull, 0x20100020001c8080ull, 0x00a1026048100500ull,
+	0x0052240080080180ull, 0x0002000410080200ull, 0x2018081002010400ull, 0x004084010e805200ull,
+	0x406020800100c091ull, 0x4000102102c00083ull, 0x0200200009410031ull, 0x60010210008c2821ull,
+	0x0002002028041082ull, 0x8402009025041802ull, 0x0000421800900114ull, 0x8000008021040042ull
+};
+constexpr std::array<bitboard, SQUARES_COUNT> bishop_magics = {
+	0x0010048988020020ull, 0x0009024800410140ull, 0x0004840400400400ull, 0x048c0d0212008008ull,
+	0x1441104001100025ull, 0x0008900420820c04ull, 0x128c0c0104500100ull, 0x0480820812010420ull,
+	0x812140020a040110ull, 0xa0000d0408005100ull, 0x0408440400820000ull, 0x4100082080210080ull,
+	0x1000511040008114ull, 0x0000809004200600ull, 0x0300288845082002ull, 0x00400201113b1010ull,
+	0x0020114002048532ull, 0xa002000404080a05ull, 0x011010520400c248ull, 0x0104082041022000ull,
+	0x0002100401200000ull, 0x8110804500600200ull, 0x0000880602b00820ull, 0x4091012244020194ull,
+	0x0020610010060200ull, 0x80020801200800a0ull, 0x002e020045240400ull, 0x200c004008081100ull,
+	0x0003840000802010ull, 0x4010490012010314ull, 0x80008401408a4801ull, 0x20608080820202a0ull,
+	0x0004100800042010ull, 0x1114012000180210ull, 0x04a4040400060821ull, 0x2902220080080082ull,
+	0x0020008400988020ull, 0xc020021880024800ull, 0x11020c0401050898ull, 0x2124040a8287d040ull,
+	0x0806122020020400ull, 0x01008208020020a0ull, 0x08e02010c808d000ull, 0x0000026011000804ull,
+	0x00c5200410100100ull, 0x8041010101023202ull, 0x0904080204004048ull, 0x6241080105400101ull,
+	0x8044440420180512ull, 0x0204230402210100ull, 0x01070020a4101201ull, 0x00a1018142020400ull,
+	0x002800110a02010aull, 0x010060081108414dull, 0x1010214821024088ull, 0x0046024206020960ull,
+	0x0080840402020201ull, 0x000808818c052090ull, 0x0020000021080812ull, 0x0004010c128c0400ull,
+	0x0000040010020e00ull, 0x0000086120c21182ull, 0x0000410404240442ull, 0x0004606206020870ull
+};
+
+void fill_tables(std::array<sliding_attack_table, SQUARES_COUNT> &tables, std::vector<bitboard> &storage, const std::array<int, 4> &directions, const std::array<bitboard, SQUARES_COUNT> &magics, bitboard (*slow_attacks)(int, bitboard)) {
+	std::array<size_t, SQUARES_COUNT> offsets;
+	size_t total = 0;
+	for (int square = 0; square < SQUARES_COUNT; ++square) {
+		tables[square].mask = relevant_occupancy(square, directions);
+		tables[square].shift = 64 - __builtin_popcountll(tables[square].mask);
+		offsets[square] = total;
+		total += size_t(1) << __builtin_popcountll(tables[square].mask);
+	}
+	storage.assign(total, 0);
+	for (int square = 0; square < SQUARES_COUNT; ++square) {
+		sliding_attack_table &table = tables[square];
+		table.magic = magics[square];
+		table.attacks = storage.data() + offsets[square];
+		for (bitboard occupancy : subsets_of(table.mask)) {
+			bitboard &slot = storage[offsets[square] + table.index(occupancy)];
+			bitboard attacks = slow_attacks(square, occupancy);
+			assert(slot == 0 || slot == attacks); //Every attack set is non-empty, so 0 means not filled yet
+			slot = attacks;
+		}
+	}
+}
+
+struct sliding_tables_initializer {
+	sliding_tables_initializer() {
+		fill_tables(rook_tables, rook_attack_storage, {0, 1, 4, 5}, rook_magics, slow_rook_attacks);
+		fill_tables(bishop_tables, bishop_attack_storage, {2, 3, 6, 7}, bishop_magics, slow_bishop_attacks);
+	}
+} initializer;
+
+}
@@ -0,0 +1,109 @@
+#ifndef ATTACKS_H
+#define ATTACKS_H
+#include <array>
+#include <utility>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+#include "board.hpp"
+
+constexpr int SQUARES_COUNT = BOARD_WIDTH * BOARD_HEIGHT;
+
+using square_table = std::array<bitboard, SQUARES_COUNT>;
+
+template <size_t N> consteval square_table make_hopping_attacks(const std::array<std::pair<int, int>, N> &dirs) {
+	square_table ret{};
+	for (int x = 0; x < BOARD_HEIGHT; ++x) for (int y = 0; y < BOARD_WIDTH; ++y) {
+		for (auto [dx, dy] : dirs) {
+			int new_x = x + dx, new_y = y + dy;
+			if (new_x >= 0 && new_x < BOARD_HEIGHT && new_y >= 0 && new_y < BOARD_WIDTH)
+				ret[square_index(x, y)] |= square_bit(new_x, new_y);
+		}
+	}
+	return ret;
+}
+
+constexpr square_table knight_attacks = make_hopping_attacks<8>({{{1, 2}, {2, 1}, {1, -2}, {2, -1}, {-1, 2}, {-2, 1}, {-1, -2}, {-2, -1}}});
+constexpr square_table king_attacks = make_hopping_attacks<8>({{{0, 1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {-1, -1}, {-1, 0}, {-1, 1}}});
+constexpr std::array<square_table, 2> pawn_attacks = {make_hopping_attacks<2>({{{1, -1}, {1, 1}}}), make_hopping_attacks<2>({{{-1, -1}, {-1, 1}}})}; /// <Indexed by player
+
+/// First 4 directions increase the square index, last 4 decrease it
+constexpr std::array<std::pair<int, int>, 8> RAY_DIRECTIONS = {{{1, 0}, {0, 1}, {1, 1}, {1, -1}, {-1, 0}, {0, -1}, {-1, -1}, {-1, 1}}};
+
+consteval std::array<square_table, 8> make_rays() {
+	std::array<square_table, 8> ret{};
+	for (size_t d = 0; d < RAY_DIRECTIONS.size(); ++d) {
+		auto [dx, dy] = RAY_DIRECTIONS[d];
+		for (int x = 0; x < BOARD_HEIGHT; ++x) for (int y = 0; y < BOARD_WIDTH; ++y) {
+			for (int new_x = x + dx, new_y = y + dy; new_x >= 0 && new_x < BOARD_HEIGHT && new_y >= 0 && new_y < BOARD_WIDTH; new_x += dx, new_y += dy)
+				ret[d][square_index(x, y)] |= square_bit(new_x, new_y);
+		}
+	}
+	return ret;
+}
+
+constexpr std::array<square_table, 8> rays = make_rays();
+
+inline bitboard ray_attacks(int direction, int square, bitboard occupied) {
+	bitboard attacks = rays[direction][square], blockers = attacks & occupied;
+	if (blockers) {
+		int blocker = direction < 4 ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers);
+		attacks ^= rays[direction][blocker];
+	}
+	return attacks;
+}
+
+/// Reference implementations stepping ray by ray, only used to fill the lookup tables (and to test them)
+inline bitboard slow_rook_attacks(int square, bitboard occupied) {
+	return ray_attacks(0, square, occupied) | ray_attacks(1, square, occupied) | ray_attacks(4, square, occupied) | ray_attacks(5, square, occupied);
+}
+
+inline bitboard slow_bishop_attacks(int square, bitboard occupied) {
+	return ray_attacks(2, square, occupied) | ray_attacks(3, square, occupied) | ray_attacks(6, square, occupied) | ray_attacks(7, square, occupied);
+}
+
+/// Per-square slice of the sliding attack lookup, indexed with PEXT when the target has BMI2 and with magic multiplication otherwise
+struct sliding_attack_table {
+	bitboard mask; /// <Relevant occupancy, the ray without its last square
+	bitboard magic;
+	unsigned shift;
+	const bitboard *attacks;
+	size_t index(bitboard occupied) const {
+#ifdef __BMI2__
+		return _pext_u64(occupied, mask);
+#else
+		return ((occupied & mask) * magic) >> shift;
+#endif
+	}
+};
+
+extern std::array<sliding_attack_table, SQUARES_COUNT> rook_tables, bishop_tables; //Filled during static initialization of attacks.cpp
+
+inline bitboard rook_attacks(int square, bitboard occupied) {
+	const sliding_attack_table &table = rook_tables[square];
+	return table.attacks[table.index(occupied)];
+}
+
+inline bitboard bishop_attacks(int square, bitboard occupied) {
+	const sliding_attack_table &table = bishop_tables[square];
+	return table.attacks[table.index(occupied)];
+}
+
+inline bitboard queen_attacks(int square, bitboard occupied) {
+	return rook_attacks(square, occupied) | bishop_attacks(square, occupied);
+}
+
+/// Squares attacked by a piece, for pawns only the diagonal captures
+inline bitboard attacks_from(uint8_t raw_piece, uint8_t player, int square, bitboard occupied) {
+	switch (raw_piece) {
+		case PAWN: return pawn_attacks[player][square];
+		case KNIGHT: return knight_attacks[square];
+		case BISHOP: return bishop_attacks(square, occupied);
+		case ROOK: return rook_attacks(square, occupied);
+		case QUEEN: return queen_attacks(square, occupied);
+		case KING: return king_attacks[square];
+	}
+	__builtin_unreachable();
+}
+
+#endif
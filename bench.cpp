@@ -0,0 +1,339 @@
+#include <bits/stdc++.h>
+#include "board.hpp"
+#include "board_set.hpp"
+#include "instrumentation.hpp"
+using namespace std;
+
+struct bench_position {
+	const char *name;
+	const char *fen;
+};
+
+const bench_position SUITE[] = {
+	{"opening", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"},
+	{"castling", "r3k2r/ppp2ppp/2n1bn2/3pp3/3PP3/2N1BN2/PPP2PPP/R3K2R w KQkq - 0 1"},
+	{"en-passant", "rnbqkbnr/pp1p1p1p/8/P1pPpPpP/8/8/1PP1P1P1/RNBQKBNR w KQkq c6,e6,g6 0 1"},
+	{"promotion", "n3k3/PPP4P/8/8/8/8/p4ppp/4K2N w - - 0 1"},
+	{"king-exposed", "rnb1k1nr/pppp1ppp/8/4p3/1b2P2q/5P2/PPPP2PP/RNBQKBNR w KQkq - 0 1"},
+};
+
+const chrono::milliseconds STAGE_BUDGET(300); ///< Minimum time each single position stage is repeated for
+
+struct perft_counts {
+	uint64_t leaves = 0; ///< Positions at the requested depth, once per sequence of full rolls and moves reaching them
+	uint64_t expanded = 0; ///< Positions generate_moves ran on
+	uint64_t king_captures = 0; ///< Full rolls that end the game on the spot, those aren't expanded further
+	uint64_t kept = 0; ///< Distinct positions over the full rolls, what the game can actually continue to
+};
+
+void perft(const board &b, int depth, perft_counts &counts) {
+	if (depth == 0) {
+		counts.leaves++;
+		return;
+	}
+	counts.expanded++;
+	movelist moves = b.generate_moves();
+	vector<board> kept;
+	for (const dice_roll &dice : full_dice_rolls) {
+		const move_range &roll_moves = moves.get_moves(dice);
+		if (roll_moves.empty()) counts.king_captures++;
+		kept.insert(kept.end(), roll_moves.begin(), roll_moves.end());
+		for (const board &x : roll_moves) perft(x, depth - 1, counts);
+	}
+	sort(kept.begin(), kept.end());
+	counts.kept += unique(kept.begin(), kept.end()) - kept.begin();
+}
+
+enum class generator {EAGER, LAZY};
+
+optional<generator> parse_generator(const string &x) {
+	if (x != "eager" && x != "lazy") return nullopt;
+	return x == "eager" ? generator::EAGER : generator::LAZY;
+}
+
+movelist generate(const board &b, generator g) {
+	return g == generator::EAGER ? b.generate_moves() : b.generate_moves_lazily();
+}
+
+uint64_t perft_leaves(const board &b, int depth, generator g) {
+	if (depth == 0) return 1;
+	movelist moves = generate(b, g);
+	uint64_t ret = 0;
+	for (const dice_roll &dice : full_dice_rolls)
+		for (const board &x : moves.get_moves(dice)) ret += perft_leaves(x, depth - 1, g);
+	return ret;
+}
+
+void divide(const board &b, int depth, generator g) { //Subtree sizes per roll and successor, in an order not depending on the generator so outputs can be diffed
+	assert(depth >= 1);
+	movelist moves = generate(b, g);
+	uint64_t total = 0;
+	for (const dice_roll &dice : full_dice_rolls) {
+		vector<pair<string, uint64_t>> successors;
+		for (const board &x : moves.get_moves(dice)) successors.emplace_back(x.fen(), perft_leaves(x, depth - 1, g));
+		sort(successors.begin(), successors.end());
+		uint64_t roll_total = 0;
+		for (auto &[fen, leaves] : successors) {
+			cout << dice << " " << fen << ": " << leaves << "\n";
+			roll_total += leaves;
+		}
+		cout << dice << " total: " << roll_total << (successors.empty() ? " (king capture)" : "") << "\n";
+		total += roll_total;
+	}
+	cout << "total: " << total << "\n";
+}
+
+uint64_t fen_digest(const board &b) { //FNV-1a of the FEN, which doesn't depend on the generator's internals
+	char buffer[MAX_FEN_LENGTH];
+	const size_t length = b.write_fen(buffer);
+	uint64_t ret = 0xcbf29ce484222325;
+	for (size_t i = 0; i < length; ++i) ret = (ret ^ (unsigned char)buffer[i]) * 0x100000001b3;
+	return ret;
+}
+
+struct roll_digest {
+	uint64_t leaves = 0; ///< As perft_leaves
+	uint64_t digest = 0; ///< Sum of fen_digest over those leaves, independent of the order they are reached in
+	bool operator==(const roll_digest &) const = default;
+};
+
+void digest_leaves(const board &b, int depth, roll_digest &out) {
+	if (depth == 0) {
+		out.leaves++;
+		out.digest += fen_digest(b);
+		return;
+	}
+	movelist moves = b.generate_moves_lazily();
+	for (const dice_roll &dice : full_dice_rolls)
+		for (const board &x : moves.get_moves(dice)) digest_leaves(x, depth - 1, out);
+}
+
+vector<roll_digest> root_digests(const board &b, int depth) { //By full_dice_rolls index, the leaves reached through that first roll
+	assert(depth >= 1);
+	movelist moves = b.generate_moves_lazily();
+	vector<roll_digest> ret(full_dice_rolls.size());
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i)
+		for (const board &x : moves.get_moves(full_dice_rolls[i])) digest_leaves(x, depth - 1, ret[i]);
+	return ret;
+}
+
+void print_digests(const board &b, int depth, ostream &o) { //A section of the reference file read by read_reference
+	o << "position " << depth << " " << b.fen() << "\n";
+	vector<roll_digest> digests = root_digests(b, depth);
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i) o << full_dice_rolls[i] << " " << digests[i].leaves << " " << hex << setw(16) << setfill('0') << digests[i].digest << dec << setfill(' ') << "\n";
+}
+
+/// Digests of b at depth from a reference file, sections as print_digests writes them, nullopt when the file has none
+optional<vector<roll_digest>> read_reference(const string &path, const board &b, int depth) {
+	ifstream in(path);
+	string line, header = "position " + to_string(depth) + " " + b.fen();
+	while (getline(in, line)) {
+		if (line != header) continue;
+		vector<roll_digest> ret(full_dice_rolls.size());
+		for (roll_digest &x : ret) {
+			string dice;
+			if (!(in >> dice >> x.leaves >> hex >> x.digest >> dec)) return nullopt;
+		}
+		return ret;
+	}
+	return nullopt;
+}
+
+struct differential_state {
+	uint64_t positions = 0;
+	uint64_t mismatches = 0;
+};
+
+void report_mismatch(differential_state &state, const board &b, const string &what, const dice_roll &dice = dice_roll::decode(0)) {
+	if (state.mismatches++ < 10) {
+		cerr << "Mismatch (" << what << ", dice " << dice << ") at " << b.fen() << "\n";
+		b.dump(cerr);
+	}
+}
+
+void differential(const board &b, int depth, differential_state &state) { //Eager generation, lazy generation and the king capture oracle must agree on every position of the tree, these share most of their code so see also the reference digests
+	state.positions++;
+	movelist eager = b.generate_moves(), lazy = b.generate_moves_lazily(), lazy_counted_first = b.generate_moves_lazily();
+	if (eager.count_winning_on_the_spot() != lazy_counted_first.count_winning_on_the_spot()) report_mismatch(state, b, "winning rolls");
+	std::bitset<DICE_ROLL_LENGTH> king_captures = b.king_capture_rolls();
+	for (const dice_roll &dice : full_dice_rolls) {
+		const move_range &expected = eager.get_moves(dice);
+		if (king_captures[dice.encode()] != expected.empty()) report_mismatch(state, b, "king capture oracle", dice);
+		std::set<board> expected_set(expected.begin(), expected.end());
+		if (expected_set.size() != expected.size()) report_mismatch(state, b, "duplicates", dice);
+		if (std::set<board>(lazy.get_moves(dice).begin(), lazy.get_moves(dice).end()) != expected_set) report_mismatch(state, b, "lazy moves", dice);
+		if (std::set<board>(lazy_counted_first.get_moves(dice).begin(), lazy_counted_first.get_moves(dice).end()) != expected_set) report_mismatch(state, b, "lazy moves after counting", dice);
+		if (depth > 1)
+			for (const board &x : expected) differential(x, depth - 1, state);
+	}
+}
+
+template <class F> double time_per_call_us(F &&f) { //Repeats f for at least STAGE_BUDGET
+	auto start = chrono::steady_clock::now();
+	long long calls = 0;
+	chrono::steady_clock::duration elapsed;
+	do {
+		f();
+		calls++;
+		elapsed = chrono::steady_clock::now() - start;
+	} while (elapsed < STAGE_BUDGET);
+	return chrono::duration<double, micro>(elapsed).count() / calls;
+}
+
+int main(int argc, char **argv) {
+	int max_depth = 2;
+	optional<string> only, divide_fen, differential_fen, digest_fen, reference;
+	optional<generator> g = generator::EAGER;
+	bool bad_arguments = false;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		try {
+			if (arg == "--depth" && i + 1 < argc) max_depth = stoi(argv[++i]);
+			else if (arg == "--position" && i + 1 < argc) only = argv[++i];
+			else if (arg == "--divide" && i + 1 < argc) divide_fen = argv[++i];
+			else if (arg == "--generator" && i + 1 < argc) g = parse_generator(argv[++i]);
+			else if (arg == "--differential" && i + 1 < argc) differential_fen = argv[++i];
+			else if (arg == "--reference" && i + 1 < argc) reference = argv[++i];
+			else if (arg == "--digest" && i + 1 < argc) digest_fen = argv[++i];
+			else bad_arguments = true;
+		}
+		catch (const logic_error &) { //stoi's invalid_argument and out_of_range
+			bad_arguments = true;
+		}
+	}
+	if (bad_arguments || !g || max_depth < 1) {
+		cerr << "Usage: " << argv[0] << " [--depth N] [--position NAME]\n";
+		cerr << "       " << argv[0] << " --divide FEN [--depth N] [--generator eager|lazy]\n";
+		cerr << "       " << argv[0] << " --differential FEN [--depth N] [--reference FILE]\n";
+		cerr << "       " << argv[0] << " --digest FEN [--depth N]\n";
+		cerr << "--reference compares leaf counts and FEN digests per first roll with FILE (bench-reference.txt holds ones from the original eager generator), --digest prints them in that format\n";
+		return 1;
+	}
+	board b;
+	if (optional<string> fen = divide_fen ? divide_fen : digest_fen ? digest_fen : differential_fen) {
+		if (fen_error error = try_parse_fen(*fen, b); error != fen_error::NONE) {
+			cerr << "Bad FEN: " << fen_error_message(error) << "\n";
+			return 1;
+		}
+	}
+	if (divide_fen) {
+		divide(b, max_depth, *g);
+		return 0;
+	}
+	if (digest_fen) {
+		print_digests(b, max_depth, cout);
+		return 0;
+	}
+	if (differential_fen) {
+		differential_state state;
+		differential(b, max_depth, state);
+		cout << "positions = " << state.positions << ", mismatches = " << state.mismatches << "\n";
+		if (reference) {
+			optional<vector<roll_digest>> expected = read_reference(*reference, b, max_depth);
+			if (!expected) {
+				cerr << "No digests for " << b.fen() << " at depth " << max_depth << " in " << *reference << "\n";
+				return 1;
+			}
+			vector<roll_digest> actual = root_digests(b, max_depth);
+			uint64_t reference_mismatches = 0;
+			for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+				if (actual[i] == (*expected)[i]) continue;
+				reference_mismatches++;
+				cerr << "Reference mismatch for " << full_dice_rolls[i] << ": " << actual[i].leaves << " leaves instead of " << (*expected)[i].leaves << (actual[i].leaves == (*expected)[i].leaves ? ", different positions" : "") << "\n";
+			}
+			cout << "reference rolls = " << full_dice_rolls.size() << ", mismatches = " << reference_mismatches << "\n";
+			state.mismatches += reference_mismatches;
+		}
+		return state.mismatches != 0;
+	}
+	cout << fixed << setprecision(2);
+	{
+		const int ROLLS = 1 << 16; //Per timed call, ns per roll below
+		int sink = 0;
+		mt19937 mt(10);
+		double mt_ns = time_per_call_us([&] {
+			for (int i = 0; i < ROLLS; ++i)
+				for (int _ = 0; _ < DICE_COUNT; ++_) sink += uniform_int_distribution(0, PIECES_TYPES_COUNT - 1)(mt);
+		}) * 1000 / ROLLS;
+		xoshiro256pp xoshiro(10);
+		splitmix64_generator splitmix(10);
+		double per_die_ns = time_per_call_us([&] {for (int i = 0; i < ROLLS; ++i) sink += dice_roll::roll(xoshiro).count[0];}) * 1000 / ROLLS;
+		double at_once_ns = time_per_call_us([&] {for (int i = 0; i < ROLLS; ++i) sink += dice_roll::roll_at_once(xoshiro).count[0];}) * 1000 / ROLLS;
+		double splitmix_ns = time_per_call_us([&] {for (int i = 0; i < ROLLS; ++i) sink += dice_roll::roll_at_once(splitmix).count[0];}) * 1000 / ROLLS;
+		cout << "dice: mt19937 + uniform_int_distribution per die " << mt_ns << "ns, xoshiro256++ per die " << per_die_ns << "ns, at once " << at_once_ns << "ns, splitmix64 at once " << splitmix_ns << "ns" << (sink == -1 ? " " : "") << "\n";
+	}
+	for (const bench_position &position : SUITE) {
+		if (only && *only != position.name) continue;
+		board b = parse_fen(position.fen);
+		cout << position.name << ": " << position.fen << "\n";
+
+		int sink = 0; //Keeps the stages from being optimized away
+		double eager_us = time_per_call_us([&] {sink += b.generate_moves().count_winning_on_the_spot();});
+		double oracle_us = time_per_call_us([&] {sink += b.king_capture_rolls().count();});
+		double lazy_us = time_per_call_us([&] {
+			movelist moves = b.generate_moves_lazily();
+			sink += moves.count_winning_on_the_spot() + moves.get_moves(full_dice_rolls[0]).size();
+		});
+
+		vector<board> successors; //The positions one roll away, repeated across the rolls reaching them
+		movelist moves = b.generate_moves();
+		for (const dice_roll &dice : full_dice_rolls) successors.insert(successors.end(), moves.get_moves(dice).begin(), moves.get_moves(dice).end());
+		vector<board> scratch;
+		board_set set;
+		double copy_us = time_per_call_us([&] { //Subtracted from the two stages below, which work on a fresh copy every call
+			scratch = successors;
+			sink += scratch.size();
+		});
+		double dedup_us = time_per_call_us([&] { //What generate_moves does to every layer
+			scratch = successors;
+#ifdef DICE_CHESS_SORT_DEDUP
+			sort(scratch.begin(), scratch.end());
+			scratch.erase(unique(scratch.begin(), scratch.end()), scratch.end());
+#else
+			set.deduplicate(scratch);
+#endif
+			sink += scratch.size();
+		}) - copy_us;
+		double finalize_us = time_per_call_us([&] {
+			scratch = successors;
+			for (board &x : scratch) x.finalize_en_passant();
+			sink += scratch.size();
+		}) - copy_us;
+		cout << "  stages: generate_moves " << eager_us << "us, king_capture_rolls " << oracle_us << "us, lazy count + one roll " << lazy_us << "us";
+		cout << ", over the " << successors.size() << " full roll successors: dedup " << dedup_us << "us, finalize_en_passant " << finalize_us << "us" << (sink == -1 ? " " : "") << "\n";
+
+		//FEN throughput over the same positions
+		vector<string> fens;
+		for (const board &x : successors) fens.push_back(x.fen());
+		const double per_fen = 1000.0 / fens.size(); //us per pass to ns per FEN
+		double parse_ns = per_fen * time_per_call_us([&] {for (const string &fen : fens) sink += parse_fen(fen).get_to_move();});
+		double try_parse_ns = per_fen * time_per_call_us([&] {
+			board parsed;
+			for (const string &fen : fens) sink += (int)try_parse_fen(fen, parsed) + parsed.get_to_move();
+		});
+		double fen_ns = per_fen * time_per_call_us([&] {for (const board &x : successors) sink += x.fen().size();});
+		double write_fen_ns = per_fen * time_per_call_us([&] {
+			char buffer[MAX_FEN_LENGTH];
+			for (const board &x : successors) sink += x.write_fen(buffer) + buffer[0];
+		});
+		cout << "  fen (" << fens.size() << " positions): parse_fen " << parse_ns << "ns, try_parse_fen " << try_parse_ns << "ns, fen() " << fen_ns << "ns, write_fen " << write_fen_ns << "ns" << (sink == -1 ? " " : "") << "\n";
+
+		instrumentation::reset(); //Only the perft below, not the stage timing loops
+		for (int depth = 1; depth <= max_depth; ++depth) {
+			perft_counts counts;
+			const instrumentation::totals before = instrumentation::collect();
+			auto start = chrono::steady_clock::now();
+			perft(b, depth, counts);
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			const instrumentation::totals after = instrumentation::collect();
+			cout << "  depth " << depth << ": leaves = " << counts.leaves << ", expanded = " << counts.expanded << ", king captures = " << counts.king_captures << ", kept = " << counts.kept;
+			if (instrumentation::ENABLED) { //Insertions the generator attempted against what its dedup let through, over all the layers
+				const uint64_t pushed = after.counters[instrumentation::BOARDS_PUSHED] - before.counters[instrumentation::BOARDS_PUSHED];
+				const uint64_t stored = after.counters[instrumentation::BOARDS_STORED] - before.counters[instrumentation::BOARDS_STORED];
+				cout << ", pushed = " << pushed << ", stored = " << stored;
+			}
+			cout << ", time = " << seconds * 1000 << "ms, " << counts.expanded / seconds << " expanded/s, " << counts.leaves / seconds << " leaves/s\n";
+		}
+		instrumentation::dump(cout);
+	}
+}
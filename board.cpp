@@ -1,4 +1,9 @@
 #include "board.hpp"
+#include "attacks.hpp"
+#include "zobrist.hpp"
+#include "board_set.hpp"
+#include "instrumentation.hpp"
+#include "packed_board.hpp"
 #include <cassert>
 #include <algorithm>
 #include <iomanip>
@@ -58,13 +63,62 @@ std::vector <dice_roll> dice_roll::strict_subsets() const {
 	return ret;
 }
 
-movelist::movelist(const std::array<std::vector<board>, DICE_ROLL_LENGTH> &moves_) : moves(moves_) {}
-movelist::movelist(std::array<std::vector<board>, DICE_ROLL_LENGTH> &&moves_) : moves(std::move(moves_)) {}
+const size_t ARENA_BLOCK_SIZE = 1024, MAX_SPARE_ARENA_BLOCKS = 256;
+static thread_local std::vector<std::vector<board>> spare_arena_blocks;
+
+board_arena::~board_arena() {
+	for (std::vector<board> &block : this->blocks) {
+		if (spare_arena_blocks.size() >= MAX_SPARE_ARENA_BLOCKS) break;
+		block.clear();
+		spare_arena_blocks.push_back(std::move(block));
+	}
+}
+
+std::span<board> board_arena::append(std::span<const board> boards) {
+	if (boards.empty()) return {};
+	if (this->blocks.empty() || this->blocks.back().capacity() - this->blocks.back().size() < boards.size()) {
+		std::vector<board> block;
+		if (!spare_arena_blocks.empty() && spare_arena_blocks.back().capacity() >= boards.size()) {
+			block = std::move(spare_arena_blocks.back());
+			spare_arena_blocks.pop_back();
+		}
+		else block.reserve(std::max(ARENA_BLOCK_SIZE, boards.size()));
+		this->blocks.push_back(std::move(block));
+	}
+	std::vector<board> &block = this->blocks.back();
+	size_t begin = block.size();
+	for (const board &b : boards) block.push_back(b); //Never reallocates, so boards may come from this very block
+	return std::span<board>(block.data() + begin, boards.size());
+}
+
+movelist::movelist(const std::array<std::vector<board>, DICE_ROLL_LENGTH> &moves_) {
+	for (size_t dice_roll_id = 0; dice_roll_id < DICE_ROLL_LENGTH; ++dice_roll_id)
+		this->moves[dice_roll_id] = std::span<const board>(this->layers.arena.append(moves_[dice_roll_id]));
+	this->computed.set();
+}
+movelist::movelist(const board &origin) : origin(origin) {}
+
+const std::bitset<DICE_ROLL_LENGTH> &movelist::king_captures() const {
+	if (!this->king_captures_mask) this->king_captures_mask = this->origin.king_capture_rolls();
+	return *this->king_captures_mask;
+}
+
+void movelist::compute(size_t dice_roll_id) const {
+	this->computed[dice_roll_id] = true;
+	if (this->king_captures_mask && (*this->king_captures_mask)[dice_roll_id]) return;
+	this->origin.build_layer(this->layers, dice_roll_id);
+	if (this->layers.king_capture_found[dice_roll_id]) return;
+	if (!this->layers.boards[dice_roll_id].empty()) this->moves[dice_roll_id] = this->layers.boards[dice_roll_id];
+	else this->moves[dice_roll_id] = this->origin.fallback_moves(this->layers, dice_roll_id);
+}
 
 int movelist::count_winning_on_the_spot() const {
 	int ret = 0;
 	for (auto &dice : full_dice_rolls) {
-		if (this->get_moves(dice).empty()) {
+		bool winning;
+		if (!this->computed[dice.encode()]) winning = this->king_captures()[dice.encode()]; //Don't materialize the full roll just to check for king capture
+		else winning = this->moves[dice.encode()].empty();
+		if (winning) {
 			ret += dice.combinations();
 		}
 	}
@@ -75,14 +129,6 @@ uint8_t board::get_to_move() const {
 	return this->to_move;
 }
 
-dice_roll dice_roll::roll(std::mt19937 &rng) {
-	dice_roll ret = {};
-	for (int _ = 0; _ < DICE_COUNT; ++_) {
-		ret.count[std::uniform_int_distribution(0, PIECES_TYPES_COUNT - 1)(rng)]++;
-	}
-	return ret;
-}
-
 dice_roll parse_dice_roll(const std::string &s) {
 	dice_roll ret = {};
 	for (char x : s) {
@@ -98,12 +144,27 @@ dice_roll parse_dice_roll(const std::string &s) {
 	return ret;
 }
 
+std::optional<dice_roll> try_parse_dice_roll(std::string_view s) {
+	if (s.size() != DICE_COUNT) return std::nullopt;
+	dice_roll ret = {};
+	for (char x : s) {
+		size_t i = 0;
+		while (i < PIECES_TYPES_COUNT && piece_strings[i][0] != x) ++i;
+		if (i == PIECES_TYPES_COUNT) return std::nullopt;
+		ret.count[i]++;
+	}
+	return ret;
+}
 
 void board::flip_in_place() {
 	reverse(squares.begin(), squares.end());
 	to_move ^= 1;
 	for (auto &row : squares) for (auto &square : row) if (!is_empty(square)) square ^= 1;
 	castling_mask = (castling_mask >> 2 | castling_mask << 2) & 0xf;
+	static_assert(BOARD_HEIGHT == 8);
+	for (bitboard &x : piece_bitboards) x = __builtin_bswap64(x);
+	player_bitboards = {__builtin_bswap64(player_bitboards[BLACK]), __builtin_bswap64(player_bitboards[WHITE])};
+	recompute_hash();
 }
 
 board board::flip() const {
@@ -115,6 +176,7 @@ board board::flip() const {
 void board::flip_horizontally_in_place() {
 	assert(castling_mask == 0);
 	for (auto &row : squares) std::reverse(row.begin(), row.end());
+	recompute_bitboards();
 	uint8_t new_enpassant_mask = 0;
 	for (int i = 0; i < BOARD_WIDTH; ++i) {
 		if (this->en_passant_mask >> i & 1) {
@@ -122,134 +184,223 @@ void board::flip_horizontally_in_place() {
 		}
 	}
 	this->en_passant_mask = new_enpassant_mask;
+	recompute_hash();
+}
+
+struct symmetric_image { //What board::operator<=> compares, for a board after some symmetry
+	std::array<bitboard, PIECES_TYPES_COUNT> piece_bitboards;
+	std::array<bitboard, 2> player_bitboards;
+	uint8_t castling_mask, to_move, en_passant_mask;
+	auto operator<=>(const symmetric_image &oth) const = default;
+
+	static constexpr int FLIP = 1, MIRROR = 2;
+	symmetric_image apply(int symmetry) const {
+		symmetric_image ret = *this;
+		if (symmetry & MIRROR) {
+			for (bitboard &x : ret.piece_bitboards) x = mirror_files(x);
+			for (bitboard &x : ret.player_bitboards) x = mirror_files(x);
+			ret.en_passant_mask = mirror_files(ret.en_passant_mask);
+		}
+		if (symmetry & FLIP) {
+			for (bitboard &x : ret.piece_bitboards) x = __builtin_bswap64(x);
+			ret.player_bitboards = {__builtin_bswap64(ret.player_bitboards[BLACK]), __builtin_bswap64(ret.player_bitboards[WHITE])};
+			ret.castling_mask = (ret.castling_mask >> 2 | ret.castling_mask << 2) & 0xf;
+			ret.to_move ^= 1;
+		}
+		return ret;
+	}
+};
+
+board board::canonical() const { //Shifts aren't symmetries in general, the edges of the board limit different pieces after shifting
+	const symmetric_image image = {this->piece_bitboards, this->player_bitboards, this->castling_mask, this->to_move, this->en_passant_mask};
+	int symmetry = 0; //Picked on the bitboards alone, only the winner gets built
+	symmetric_image best = image;
+	for (int candidate_symmetry = 1; candidate_symmetry < (this->castling_mask ? 2 : 4); ++candidate_symmetry) {
+		symmetric_image candidate = image.apply(candidate_symmetry);
+		if (candidate < best) {
+			best = candidate;
+			symmetry = candidate_symmetry;
+		}
+	}
+	board ret = *this;
+	if (symmetry & symmetric_image::MIRROR) ret.flip_horizontally_in_place();
+	if (symmetry & symmetric_image::FLIP) ret.flip_in_place();
+	return ret;
 }
 
 uint8_t board::get_castling_mask() const {return this->castling_mask;}
 uint8_t board::get_en_passant_mask() const {return this->en_passant_mask;}
 
 std::pair <int, int> board::get_king_position(uint8_t player) const {
-	for (int i = 0; i < BOARD_HEIGHT; ++i)
-		for (int j = 0; j < BOARD_WIDTH; ++j)
-			if (this->squares[i][j] == make_piece(KING, player))
-				return {i, j};
-	__builtin_unreachable();
+	bitboard king = this->pieces(KING, player);
+	assert(king);
+	int square = __builtin_ctzll(king);
+	return {square / BOARD_WIDTH, square % BOARD_WIDTH};
 }
 
-board parse_fen(const std::string &fen){ //TODO: string_view
-	const std::vector<std::string> content = split(fen, ' ');
-	assert(content.size() >= 4 && content.size() <= 6);
-	const std::string &board_content = content[0], to_move = content[1], castling = content[2], en_passant = content[3];
-	const std::vector<std::string> rows = split(board_content, '/');
-	assert(rows.size() == BOARD_HEIGHT);
-	board ret;
-	for (size_t i = 0; i < BOARD_HEIGHT; ++i) {
-		const std::string &row = rows[BOARD_HEIGHT - i - 1];
-		size_t at = 0;
-		for (char x : row) {
-			if (x >= '0' && x <= '9') {
-				size_t go = x - '0';
-				for (size_t j = 0; j < go; ++j) {
-					assert(at < BOARD_WIDTH);
-					ret.squares[i][at++] = EMPTY;
-				}
-			}
-			else {
-				assert(at < BOARD_WIDTH);
-				switch(x) {
-					case 'k': ret.squares[i][at] = KING | BLACK; break;
-					case 'K': ret.squares[i][at] = KING | WHITE; break;
-					case 'q': ret.squares[i][at] = QUEEN | BLACK; break;
-					case 'Q': ret.squares[i][at] = QUEEN | WHITE; break;
-					case 'r': ret.squares[i][at] = ROOK | BLACK; break;
-					case 'R': ret.squares[i][at] = ROOK | WHITE; break;
-					case 'b': ret.squares[i][at] = BISHOP | BLACK; break;
-					case 'B': ret.squares[i][at] = BISHOP | WHITE; break;
-					case 'n': ret.squares[i][at] = KNIGHT | BLACK; break;
-					case 'N': ret.squares[i][at] = KNIGHT | WHITE; break;
-					case 'p': ret.squares[i][at] = PAWN | BLACK; break;
-					case 'P': ret.squares[i][at] = PAWN | WHITE; break;
-					default: assert(false);
-				}
-				at++;
-			}
+static const std::array<char, 16> fen_characters = []{ //Indexed by square contents, 0 for values that aren't a piece
+	std::array<char, 16> ret{};
+	const char white[] = "PNBRQK", black[] = "pnbrqk";
+	for (uint8_t piece = PAWN; piece <= KING; piece += 2) {
+		ret[make_piece(piece, WHITE)] = white[piece / 2 - 1];
+		ret[make_piece(piece, BLACK)] = black[piece / 2 - 1];
+	}
+	return ret;
+}();
+
+static const std::array<uint8_t, 256> fen_character_pieces = []{ //The other way around, EMPTY for characters that aren't a piece
+	std::array<uint8_t, 256> ret{};
+	for (uint8_t i = 0; i < fen_characters.size(); ++i)
+		if (fen_characters[i]) ret[(unsigned char)fen_characters[i]] = i;
+	return ret;
+}();
+
+const char *fen_error_message(fen_error error) {
+	switch (error) {
+		case fen_error::NONE: return "no error";
+		case fen_error::FIELD_COUNT: return "expected 4 to 6 space separated fields";
+		case fen_error::RANK_COUNT: return "expected 8 ranks";
+		case fen_error::RANK_LENGTH: return "rank not 8 squares long";
+		case fen_error::PIECE: return "unknown piece";
+		case fen_error::TO_MOVE: return "side to move not w or b";
+		case fen_error::CASTLING: return "unknown castling right";
+		case fen_error::EN_PASSANT: return "bad en passant square";
+		case fen_error::KING_COUNT: return "expected one king per side";
+		case fen_error::PAWN_RANK: return "pawn on the first or last rank";
+		case fen_error::PIECE_COUNT: return "more than 32 pieces";
+		case fen_error::CASTLING_PIECES: return "castling right without its king and rook on their squares";
+	}
+	return "unknown error";
+}
+
+fen_error try_parse_fen(std::string_view fen, board &out) {
+	std::array<std::string_view, 6> fields;
+	size_t fields_count = 0;
+	for (size_t start = 0; ; ) {
+		size_t end = fen.find(' ', start);
+		if (fields_count == fields.size()) return fen_error::FIELD_COUNT;
+		fields[fields_count++] = fen.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+		if (end == std::string_view::npos) break;
+		start = end + 1;
+	}
+	if (fields_count < 4) return fen_error::FIELD_COUNT;
+	const std::string_view board_content = fields[0], to_move = fields[1], castling = fields[2], en_passant = fields[3];
+
+	out.piece_bitboards = {};
+	out.player_bitboards = {};
+	out.key = 0;
+	int rank = BOARD_HEIGHT - 1, file = 0;
+	for (char x : board_content) { //Bitboards and the key are built along, instead of recompute_bitboards and recompute_hash passing over all the squares again
+		if (x == '/') {
+			if (file != BOARD_WIDTH) return fen_error::RANK_LENGTH;
+			if (rank == 0) return fen_error::RANK_COUNT;
+			rank--;
+			file = 0;
+		}
+		else if (x >= '0' && x <= '9') {
+			if (file + (x - '0') > BOARD_WIDTH) return fen_error::RANK_LENGTH;
+			for (int j = 0; j < x - '0'; ++j) out.squares[rank][file++] = EMPTY;
+		}
+		else {
+			uint8_t piece = fen_character_pieces[(unsigned char)x];
+			if (piece == EMPTY) return fen_error::PIECE;
+			if (file == BOARD_WIDTH) return fen_error::RANK_LENGTH;
+			out.squares[rank][file] = piece;
+			out.piece_bitboards[to_raw_piece(piece) / 2 - 1] |= square_bit(rank, file);
+			out.player_bitboards[get_player(piece)] |= square_bit(rank, file);
+			out.key ^= zobrist.piece_square[piece][square_index(rank, file)];
+			file++;
 		}
-		assert(at == BOARD_WIDTH);
 	}
-	assert(to_move == "b" || to_move == "w");
-	ret.to_move = to_move == "b" ? BLACK : WHITE;
-	ret.castling_mask = 0;
+	if (rank != 0) return fen_error::RANK_COUNT;
+	if (file != BOARD_WIDTH) return fen_error::RANK_LENGTH;
+
+	if (to_move != "w" && to_move != "b") return fen_error::TO_MOVE;
+	out.to_move = to_move == "b" ? BLACK : WHITE;
+	out.castling_mask = 0;
 	for (char x : castling) {
 		switch (x) {
-			case 'K': ret.castling_mask |= WHITE_KINGSIDE_CASTLE; break;
-			case 'k': ret.castling_mask |= BLACK_KINGSIDE_CASTLE; break;
-			case 'Q': ret.castling_mask |= WHITE_QUEENSIDE_CASTLE; break;
-			case 'q': ret.castling_mask |= BLACK_QUEENSIDE_CASTLE; break;
+			case 'K': out.castling_mask |= WHITE_KINGSIDE_CASTLE; break;
+			case 'k': out.castling_mask |= BLACK_KINGSIDE_CASTLE; break;
+			case 'Q': out.castling_mask |= WHITE_QUEENSIDE_CASTLE; break;
+			case 'q': out.castling_mask |= BLACK_QUEENSIDE_CASTLE; break;
 			case '-': break;
-			default: assert(false);	
+			default: return fen_error::CASTLING;
 		}
 	}
-	ret.en_passant_mask = 0;
-	if (en_passant == "-")
-		;
-	else {
-		const std::vector<std::string> en_passant_squares = split(en_passant, ',');
-		for (const std::string &x : en_passant_squares) {
-			assert(x.size() == 2u);
-			assert(x[1] == (ret.to_move == BLACK ? '3' : '6'));
-			assert(x[0] >= 'a' && x[0] <= 'h');
-			ret.en_passant_mask |= 1 << (x[0] - 'a');
+	out.en_passant_mask = 0;
+	if (en_passant != "-") {
+		for (size_t at = 0; ; at += 3) { //Comma separated squares, all on the rank the opponent's pawns skipped
+			std::string_view x = en_passant.substr(at, 2);
+			if (x.size() != 2u || x[0] < 'a' || x[0] > 'h' || x[1] != (out.to_move == BLACK ? '3' : '6')) return fen_error::EN_PASSANT;
+			out.en_passant_mask |= 1 << (x[0] - 'a');
+			if (at + 2 == en_passant.size()) break;
+			if (en_passant[at + 2] != ',') return fen_error::EN_PASSANT;
 		}
 	}
+	out.key ^= zobrist.castling[out.castling_mask] ^ zobrist.en_passant[out.en_passant_mask] ^ (out.to_move == BLACK ? zobrist.black_to_move : 0);
+	return check_position(out);
+}
+
+fen_error check_position(const board &b) {
+	if (__builtin_popcountll(b.pieces(KING, WHITE)) != 1 || __builtin_popcountll(b.pieces(KING, BLACK)) != 1) return fen_error::KING_COUNT;
+	if (b.piece_bitboards[PAWN / 2 - 1] & (square_bit(0, 0) * 0xff | square_bit(BOARD_HEIGHT - 1, 0) * 0xff)) return fen_error::PAWN_RANK;
+	if (__builtin_popcountll(b.occupied()) > packed_board::MAX_PIECES) return fen_error::PIECE_COUNT;
+	if (b.castling_rights_in_place() != b.castling_mask) return fen_error::CASTLING_PIECES;
+	return fen_error::NONE;
+}
+
+board parse_fen(const std::string &fen) {
+	board ret;
+	[[maybe_unused]] fen_error error = try_parse_fen(fen, ret);
+	assert(error == fen_error::NONE);
 	return ret;
 }
 
-std::string board::fen() const {
-	std::stringstream ret;
+size_t board::write_fen(char *out) const {
+	char *at = out;
 	for (int i = BOARD_HEIGHT - 1; i >= 0; --i) {
 		int current_blank = 0;
-		auto push_char = [&](char x){
-			if (current_blank) ret << current_blank;
-			current_blank = 0;
-			ret << x;
-		};
 		for (int j = 0; j < BOARD_WIDTH; ++j) {
-			switch(this->squares[i][j]) {
-				case make_piece(KING, WHITE): push_char('K'); break;
-				case make_piece(QUEEN, WHITE): push_char('Q'); break;
-				case make_piece(ROOK, WHITE): push_char('R'); break;
-				case make_piece(BISHOP, WHITE): push_char('B'); break;
-				case make_piece(KNIGHT, WHITE): push_char('N'); break;
-				case make_piece(PAWN, WHITE): push_char('P'); break;
-				case make_piece(KING, BLACK): push_char('k'); break;
-				case make_piece(QUEEN, BLACK): push_char('q'); break;
-				case make_piece(ROOK, BLACK): push_char('r'); break;
-				case make_piece(BISHOP, BLACK): push_char('b'); break;
-				case make_piece(KNIGHT, BLACK): push_char('n'); break;
-				case make_piece(PAWN, BLACK): push_char('p'); break;
-				case EMPTY: current_blank++; break;
-				default: assert(false); break; 
+			const uint8_t square = this->squares[i][j];
+			if (square == EMPTY) {
+				current_blank++;
+				continue;
 			}
+			assert(square < fen_characters.size() && fen_characters[square]);
+			if (current_blank) *at++ = '0' + current_blank;
+			current_blank = 0;
+			*at++ = fen_characters[square];
 		}
-		if (current_blank) ret << current_blank;
-		if (i) ret << "/";
+		if (current_blank) *at++ = '0' + current_blank;
+		if (i) *at++ = '/';
 	}
-	ret << " " << (this->to_move == WHITE ? 'w' : 'b') << " ";
-	if (this->castling_mask & WHITE_KINGSIDE_CASTLE) ret << "K";
-	if (this->castling_mask & WHITE_QUEENSIDE_CASTLE) ret << "Q";
-	if (this->castling_mask & BLACK_KINGSIDE_CASTLE) ret << "k";
-	if (this->castling_mask & BLACK_QUEENSIDE_CASTLE) ret << "q";
-	if (!this->castling_mask) ret << "-";
-	ret << " ";
+	*at++ = ' ';
+	*at++ = this->to_move == WHITE ? 'w' : 'b';
+	*at++ = ' ';
+	if (this->castling_mask & WHITE_KINGSIDE_CASTLE) *at++ = 'K';
+	if (this->castling_mask & WHITE_QUEENSIDE_CASTLE) *at++ = 'Q';
+	if (this->castling_mask & BLACK_KINGSIDE_CASTLE) *at++ = 'k';
+	if (this->castling_mask & BLACK_QUEENSIDE_CASTLE) *at++ = 'q';
+	if (!this->castling_mask) *at++ = '-';
+	*at++ = ' ';
 	bool first = true;
 	for (int i = 0; i < BOARD_WIDTH; ++i) {
 		if (this->en_passant_mask >> i & 1) {
-			if (!first) ret << ",";
+			if (!first) *at++ = ',';
 			first = false;
-			ret << (char)('a' + i) << (this->to_move == BLACK ? '3' : '6');
+			*at++ = 'a' + i;
+			*at++ = this->to_move == BLACK ? '3' : '6';
 		}
 	}
-	if (!this->en_passant_mask) ret << "-";
-	return ret.str();
+	if (!this->en_passant_mask) *at++ = '-';
+	assert(size_t(at - out) <= MAX_FEN_LENGTH);
+	return at - out;
+}
+
+std::string board::fen() const {
+	char buffer[MAX_FEN_LENGTH];
+	return std::string(buffer, this->write_fen(buffer));
 }
 
 int dice_roll::encode() const {
@@ -305,8 +456,10 @@ int dice_roll::combinations() const {
 	return numerator / denominator;
 }
 
-const std::vector <board> &movelist::get_moves(const dice_roll &x) const {
-	return this->moves[x.encode()];
+const move_range &movelist::get_moves(const dice_roll &x) const & {
+	size_t dice_roll_id = x.encode();
+	if (!this->computed[dice_roll_id]) this->compute(dice_roll_id);
+	return this->moves[dice_roll_id];
 }
 
 std::ostream &operator<<(std::ostream &o, const dice_roll &dice) {
@@ -327,6 +480,13 @@ dice_roll dice_roll::append(uint8_t piece) const {
 	return ret;
 }
 
+dice_roll dice_roll::remove(uint8_t piece) const {
+	dice_roll ret = *this;
+	assert(ret.count[piece / 2 - 1]);
+	ret.count[piece / 2 - 1]--;
+	return ret;
+}
+
 uint8_t board::get_reachable_en_passant_first_heuristic(uint8_t player) const {
 	static_assert(BOARD_HEIGHT == 8 && DICE_COUNT == 3);
 	uint8_t ret = 0;
@@ -381,7 +541,7 @@ void board::finalize_en_passant() {
 	int square_hopped_rank = (this->to_move == BLACK ? 2 : 5); //TODO: better name
 	int capture_king_dist = this->min_moves_to_capture_king_with_pawns(this->to_move);
 	if (capture_king_dist == 1) {
-		this->en_passant_mask = 0;
+		this->set_en_passant_mask(0);
 		return;
 	}
 	for (size_t i = 0; i < BOARD_WIDTH; ++i) { //TODO: how much is there to gain from using __ctz to iterate through bits in all contexts like this?
@@ -389,9 +549,9 @@ void board::finalize_en_passant() {
 			if (!is_empty(this->squares[square_hopped_rank][i])) {
 				assert(is_players(this->squares[square_hopped_rank][i], opponent(this->to_move)));
 				if (this->squares[square_hopped_rank][i] == make_piece(opponent(this->to_move), KING))
-					this->en_passant_mask &= ~(1 << i);
+					this->remove_en_passant(i);
 				else if ((i == 0 || this->squares[en_passant_rank][i - 1] != make_piece(PAWN, this->to_move)) && (i == BOARD_WIDTH - 1 || this->squares[en_passant_rank][i + 1] != make_piece(PAWN, this->to_move)))
-					this->en_passant_mask &= ~(1 << i);
+					this->remove_en_passant(i);
 				//TODO: if !is_attacked_by_anything_other_than_the_pawn(square_hopped_rank, i, this->to_move) reset i-th bit (other than that pawn => possibly 2 pawns)
 			}
 		}
@@ -461,268 +621,317 @@ void board::finalize_en_passant() {
 		// std::cerr << MASK(mask_5th_rank) << "\n";
 		// std::cerr << MASK(reachable) << "\n";
 
-	this->en_passant_mask &= (reachable << 1) | (reachable >> 1);
+	this->set_en_passant_mask(this->en_passant_mask & ((reachable << 1) | (reachable >> 1)));
 
 }
 
-movelist board::generate_moves() const {
-	uint8_t current_enpassant_mask = this->en_passant_mask, current_to_move = this->to_move;
-	std::array<std::vector<board>, DICE_ROLL_LENGTH> moves;
-	std::array<bool, DICE_ROLL_LENGTH> king_capture_found = {};
-	moves[0].push_back(*this);
-	moves[0][0].en_passant_mask = 0;
-	moves[0][0].to_move ^= 1;
-
-	uint8_t reachable_en_passant = this->get_reachable_en_passant_first_heuristic(opponent(this->to_move));
-	
+template <class F> bool board::for_each_move(const board &b, uint8_t piece, uint8_t reachable_en_passant, F &&push) const { //this is the position the whole move starts from, b an intermediate one, returns true on king capture
+	const uint8_t current_to_move = this->to_move, current_enpassant_mask = this->en_passant_mask;
+	const bitboard own = b.occupied_by(current_to_move), occupied = b.occupied(), opponent_king = b.pieces(KING, opponent(current_to_move));
 
-	auto mark_king_capture_rec = [&](const dice_roll &x, auto &self) -> void {
-		assert(x.total_rolls() >= 1);
-		if (king_capture_found[x.encode()]) return;
-		king_capture_found[x.encode()] = true;
-		moves[x.encode()].clear();
-		if (x.total_rolls() < DICE_COUNT)
-			for (uint8_t piece : PIECE_TYPES)
-				self(x.append(piece), self);
+	auto go_one_pawn_forward = [&](int start_x, int start_y, int dir_x, bool is_double_step, uint8_t promote_to) -> void {
+		int new_x = start_x + dir_x;
+		int opp_en_passant_rank = current_to_move == WHITE ? 3 : 4;
+		board new_board = b;
+		new_board.clear_square(start_x, start_y);
+		new_board.put_piece(new_x, start_y, make_piece(promote_to, current_to_move));
+		if (is_double_step) new_board.add_en_passant(start_y, reachable_en_passant);
+		else if (start_x == opp_en_passant_rank) new_board.remove_en_passant(start_y);
+		push(new_board);
 	};
 
-	auto mark_king_capture = [&](const dice_roll &x) {
-		mark_king_capture_rec(x, mark_king_capture_rec);
+	auto go_one_pawn_diagonally = [&](int start_x, int start_y, int new_x, int new_y, uint8_t promote_to, bool is_en_passant) -> void {
+		int opp_en_passant_rank = current_to_move == WHITE ? 3 : 4;
+		board new_board = b;
+		new_board.clear_square(start_x, start_y);
+		new_board.put_piece(new_x, new_y, make_piece(promote_to, current_to_move));
+		if (is_en_passant) new_board.clear_square(start_x, new_y);
+		else if (start_x == opp_en_passant_rank) new_board.remove_en_passant(start_y);
+		push(new_board);
 	};
 
-	
+	for (bitboard remaining = b.pieces(piece, current_to_move); remaining; remaining &= remaining - 1) {
+		const int square = __builtin_ctzll(remaining);
+		const int i = square / BOARD_WIDTH, j = square % BOARD_WIDTH;
+		if (piece != PAWN) {
+			bitboard targets = attacks_from(piece, current_to_move, square, occupied) &~ own;
+			if (targets & opponent_king) return true;
+			for (; targets; targets &= targets - 1) {
+				int target = __builtin_ctzll(targets);
+				board new_board = b;
+				new_board.move_piece(i, j, target / BOARD_WIDTH, target % BOARD_WIDTH);
+				push(new_board);
+			}
+			continue;
+		}
+		assert(i != 0 && i != 7);
+		int go_dir = current_to_move == WHITE ? 1 : -1;
+		int promote_from_rank = current_to_move == WHITE ? 6 : 1;
+		int double_step_from_rank = current_to_move == WHITE ? 1 : 6;
+		int en_passant_rank = current_to_move == WHITE ? 4 : 3;
+		bitboard captures = pawn_attacks[current_to_move][square] & b.occupied_by(opponent(current_to_move));
+		if (captures & opponent_king) return true;
+		if (!(occupied & square_bit(i + go_dir, j))) {
+			if (i == promote_from_rank) {
+				for (uint8_t promote_to : promotions)
+					go_one_pawn_forward(i, j, go_dir, false, promote_to);
+			}
+			else {
+				go_one_pawn_forward(i, j, go_dir, false, PAWN);
+				if (i == double_step_from_rank && !(occupied & square_bit(i + 2 * go_dir, j)))
+					go_one_pawn_forward(i, j, go_dir * 2, true, PAWN);
+			}
+		}
+		for (; captures; captures &= captures - 1) {
+			int target = __builtin_ctzll(captures);
+			if (i == promote_from_rank) {
+				for (uint8_t promote_to : promotions)
+					go_one_pawn_diagonally(i, j, target / BOARD_WIDTH, target % BOARD_WIDTH, promote_to, false);
+			}
+			else {
+				go_one_pawn_diagonally(i, j, target / BOARD_WIDTH, target % BOARD_WIDTH, PAWN, false);
+			}
+		}
+		if (i == en_passant_rank && current_enpassant_mask) {
+			for (int capture_dir : {-1, 1}) {
+				int new_y = j + capture_dir;
+				if (new_y < 0 || new_y >= BOARD_WIDTH || !((current_enpassant_mask >> new_y) & 1)) continue;
+				if (b.squares[i][new_y] == make_piece(PAWN, opponent(current_to_move)) && !(occupied & square_bit(i + go_dir, new_y)))
+					go_one_pawn_diagonally(i, j, i + go_dir, new_y, PAWN, true);
+			}
+		}
+	}
+	return false;
+}
 
-	auto go_line = [&](int start_x, int start_y, int dir_x, int dir_y, const board &b, std::vector<board> &destination, const dice_roll &destination_dice_roll) -> bool {
-		for (int i = 1; ; ++i) {
-			int new_x = start_x + dir_x * i, new_y = start_y + dir_y * i;
-			if (new_x < 0 || new_x >= BOARD_WIDTH || new_y < 0 || new_y >= BOARD_HEIGHT) break;
-			if (b.squares[new_x][new_y] == make_piece(KING, opponent(current_to_move))) {
-				mark_king_capture(destination_dice_roll);
-				return true;
+template <class F> void board::for_each_castling(const board &b, F &&push) const {
+	const bitboard occupied = b.occupied();
+	const uint8_t rights = b.castling_rights_in_place(); //Other rights would move pieces off empty squares
+	if (this->to_move == WHITE) {
+		if (rights & WHITE_KINGSIDE_CASTLE) {
+			if (!(occupied & (square_bit(0, 5) | square_bit(0, 6)))) {
+				board new_board = b;
+				new_board.move_piece(0, 4, 0, 6);
+				new_board.move_piece(0, 7, 0, 5);
+				push(new_board);
 			}
-			if (is_empty(b.squares[new_x][new_y]) || is_players(b.squares[new_x][new_y], opponent(current_to_move))) {
+		}
+		if (rights & WHITE_QUEENSIDE_CASTLE) {
+			if (!(occupied & (square_bit(0, 3) | square_bit(0, 2) | square_bit(0, 1)))) {
 				board new_board = b;
-				new_board.move_piece(start_x, start_y, new_x, new_y);
-				destination.push_back(new_board);
+				new_board.move_piece(0, 4, 0, 2);
+				new_board.move_piece(0, 0, 0, 3);
+				push(new_board);
 			}
-			if (!is_empty(b.squares[new_x][new_y])) break;
 		}
-		return false;
-	};
-
-	auto go_one = [&](int start_x, int start_y, int dir_x, int dir_y, const board &b, std::vector<board> &destination, const dice_roll &destination_dice_roll) -> bool {
-		int new_x = start_x + dir_x, new_y = start_y + dir_y;
-		if (new_x < 0 || new_x >= BOARD_WIDTH || new_y < 0 || new_y >= BOARD_HEIGHT) return false;
-		if (b.squares[new_x][new_y] == make_piece(KING, opponent(current_to_move))) {
-			mark_king_capture(destination_dice_roll);
-			return true;
+	}
+	else {
+		if (rights & BLACK_KINGSIDE_CASTLE) {
+			if (!(occupied & (square_bit(7, 5) | square_bit(7, 6)))) {
+				board new_board = b;
+				new_board.move_piece(7, 4, 7, 6);
+				new_board.move_piece(7, 7, 7, 5);
+				push(new_board);
+			}
 		}
-		if (is_empty(b.squares[new_x][new_y]) || is_players(b.squares[new_x][new_y], opponent(current_to_move))) {
-			board new_board = b;
-			new_board.move_piece(start_x, start_y, new_x, new_y);
-			destination.push_back(new_board);
+		if (rights & BLACK_QUEENSIDE_CASTLE) {
+			if (!(occupied & (square_bit(7, 3) | square_bit(7, 2) | square_bit(7, 1)))) {
+				board new_board = b;
+				new_board.move_piece(7, 4, 7, 2);
+				new_board.move_piece(7, 0, 7, 3);
+				push(new_board);
+			}
 		}
-		return false;
-	};
-
-	auto go_one_pawn_forward = [&](int start_x, int start_y, int dir_x, int dir_y, const board &b, std::vector<board> &destination, bool is_double_step, uint8_t promote_to) -> bool {
-		int new_x = start_x + dir_x, new_y = start_y + dir_y;
-		if (new_x < 0 || new_x >= BOARD_WIDTH || new_y < 0 || new_y >= BOARD_HEIGHT) return false;
-		int opp_en_passant_rank = current_to_move == WHITE ? 3 : 4;
-		if (is_empty(b.squares[new_x][new_y])) {
-			board new_board = b;
-			new_board.clear_square(start_x, start_y);
-			new_board.put_piece(new_x, new_y, make_piece(promote_to, current_to_move));
-			if (is_double_step) new_board.add_en_passant(start_y, reachable_en_passant);
-			else if (start_x == opp_en_passant_rank) new_board.remove_en_passant(start_y);
-			destination.push_back(new_board);
-		}
-		return false;
-	};
+	}
+}
 
-	auto go_one_pawn_diagonally = [&](int start_x, int start_y, int dir_x, int dir_y, const board &b, std::vector<board> &destination, const dice_roll &destination_dice_roll, uint8_t promote_to) -> bool {
-		int new_x = start_x + dir_x, new_y = start_y + dir_y;
-		int en_passant_rank = current_to_move == WHITE ? 4 : 3;
-		int opp_en_passant_rank = current_to_move == WHITE ? 3 : 4;
-		if (new_x < 0 || new_x >= BOARD_WIDTH || new_y < 0 || new_y >= BOARD_HEIGHT) return false;
-		if (b.squares[new_x][new_y] == make_piece(KING, opponent(current_to_move))) {
-			mark_king_capture(destination_dice_roll);
-			return true;
-		}
-		if (!is_empty(b.squares[new_x][new_y]) && is_players(b.squares[new_x][new_y], opponent(current_to_move))) {
-			board new_board = b;
-			new_board.clear_square(start_x, start_y);
-			new_board.put_piece(new_x, new_y, make_piece(promote_to, current_to_move));
-			if (start_x == opp_en_passant_rank) new_board.remove_en_passant(start_y);
-			destination.push_back(new_board);
-		}
-		else if (start_x == en_passant_rank && ((current_enpassant_mask >> new_y) & 1) && b.squares[start_x][new_y] == make_piece(PAWN, opponent(current_to_move)) && is_empty(b.squares[new_x][new_y])) {
-			board new_board = b;
-			new_board.clear_square(start_x, start_y);
-			new_board.put_piece(new_x, new_y, make_piece(promote_to, current_to_move));
-			new_board.clear_square(start_x, new_y);
-			destination.push_back(new_board);
-		}
-		return false;
-	};
+uint8_t board::king_attacker_types(const board &b) const { //Bit piece / 2 - 1 is set if a piece of that type can capture the king, looking from the king square once for all types
+	const uint8_t player = this->to_move;
+	const bitboard opponent_king = b.pieces(KING, opponent(player));
+	if (!opponent_king) return 0;
+	const int square = __builtin_ctzll(opponent_king);
+	const bitboard occupied = b.occupied(), diagonal = bishop_attacks(square, occupied), straight = rook_attacks(square, occupied);
+	return (!!(pawn_attacks[opponent(player)][square] & b.pieces(PAWN, player)) << (PAWN / 2 - 1))
+		| (!!(knight_attacks[square] & b.pieces(KNIGHT, player)) << (KNIGHT / 2 - 1))
+		| (!!(diagonal & b.pieces(BISHOP, player)) << (BISHOP / 2 - 1))
+		| (!!(straight & b.pieces(ROOK, player)) << (ROOK / 2 - 1))
+		| (!!((diagonal | straight) & b.pieces(QUEEN, player)) << (QUEEN / 2 - 1))
+		| (!!(king_attacks[square] & b.pieces(KING, player)) << (KING / 2 - 1));
+}
 
+#ifndef DICE_CHESS_SORT_DEDUP
+static thread_local board_set dedup_set;
+#endif
+static thread_local std::vector<board> layer_buffer; //A layer is collected here and then copied to the arena in one go, sources in the arena stay put meanwhile
+
+static void deduplicate(std::vector<board> &boards) {
+	INSTRUMENT_STAGE(DEDUP);
+#ifdef DICE_CHESS_SORT_DEDUP
+	std::sort(boards.begin(), boards.end());
+	boards.erase(std::unique(boards.begin(), boards.end()), boards.end());
+#else
+	dedup_set.deduplicate(boards);
+#endif
+}
 
+board board::start_of_move() const { //Flags flip before any piece moves, so that moves generated from it reach positions with the opponent to move
+	board ret = *this;
+	ret.set_en_passant_mask(0);
+	ret.to_move ^= 1;
+	ret.key ^= zobrist.black_to_move;
+	return ret;
+}
 
-	for (size_t dice_roll_id = 0; dice_roll_id < DICE_ROLL_LENGTH; ++dice_roll_id) {
-		dice_roll current = dice_roll::decode(dice_roll_id);
-		if (current.total_rolls() >= DICE_COUNT) continue;
-		std::sort(moves[dice_roll_id].begin(), moves[dice_roll_id].end());
-		moves[dice_roll_id].erase(std::unique(moves[dice_roll_id].begin(), moves[dice_roll_id].end()), moves[dice_roll_id].end());
-		for (const board &current_board : moves[dice_roll_id]) {
-			for (size_t i = 0; i < BOARD_WIDTH ; ++i) for (size_t j = 0; j < BOARD_HEIGHT; ++j) {
-				if (is_empty(current_board.squares[i][j]) || !is_players(current_board.squares[i][j], current_to_move)) continue;
-				dice_roll destination_dice_roll = current.append(current_board.squares[i][j]);
-				size_t new_index = destination_dice_roll.encode();
-				std::vector<board> &destination = moves[new_index];
-				bool capture_found = king_capture_found[new_index];
-				auto process_line_piece = [&](const std::vector<std::pair <int, int> > &dirs) -> void {
-					if (capture_found) return;
-					for (auto [dx, dy] : dirs) if (go_line(i, j, dx, dy, current_board, destination, destination_dice_roll)) return;
-				};
-				auto process_hopping_piece = [&](const std::vector<std::pair <int, int> > &dirs) -> void {
-					if (capture_found) return;
-					for (auto [dx, dy] : dirs) if (go_one(i, j, dx, dy, current_board, destination, destination_dice_roll)) return;
-				};
-				auto process_pawn = [&]() -> void {
-					if (capture_found) return;
-					assert(i != 0 && i != 7);
-					size_t go_dir = current_to_move == WHITE ? 1 : -1;
-					size_t promote_from_rank = current_to_move == WHITE ? 6 : 1;
-					size_t double_step_from_rank = current_to_move == WHITE ? 1 : 6;
-					if (i == promote_from_rank) {
-						for (char promote_to : promotions)
-							if (go_one_pawn_forward(i, j, go_dir, 0, current_board, destination, false, promote_to)) return;
-					}
-					else {
-						if (go_one_pawn_forward(i, j, go_dir, 0, current_board, destination, false, PAWN)) return;
-						if (i == double_step_from_rank && is_empty(current_board.squares[i + go_dir][j]))
-							if (go_one_pawn_forward(i, j, go_dir * 2, 0, current_board, destination, true, PAWN))
-								return;
-					}
-					if (i == promote_from_rank) {
-						for (char promote_to : promotions) {
-							for (int capture_dir : {-1, 1})
-								if (go_one_pawn_diagonally(i, j, go_dir, capture_dir, current_board, destination, destination_dice_roll, promote_to))
-									return;
-						}
-					}
-					else {
-						for (int capture_dir : {-1, 1})
-							if (go_one_pawn_diagonally(i, j, go_dir, capture_dir, current_board, destination, destination_dice_roll, PAWN))
-								return;
-					}
-				};
-				if (current_board.squares[i][j] == make_piece(KING, current_to_move)) {
-					process_hopping_piece({{0, 1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {-1, -1}, {-1, 0}, {-1, 1}});
-				}
-				else if (current_board.squares[i][j] == make_piece(QUEEN, current_to_move)) {
-					process_line_piece({{0, 1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {-1, -1}, {-1, 0}, {-1, 1}});
-				}
-				else if (current_board.squares[i][j] == make_piece(ROOK, current_to_move)) {
-					process_line_piece({{0, 1}, {0, -1}, {1, 0}, {-1, 0}});
-				}
-				else if (current_board.squares[i][j] == make_piece(BISHOP, current_to_move)) {
-					process_line_piece({{1, 1}, {1, -1}, {-1, 1}, {-1, -1}});
-				}
-				else if (current_board.squares[i][j] == make_piece(KNIGHT, current_to_move)) {
-					process_hopping_piece({{1, 2}, {2, 1}, {1, -2}, {2, -1}, {-1, 2}, {-2, 1}, {-1, -2}, {-2, -1}, });
-				}
-				else if (current_board.squares[i][j] == make_piece(PAWN, current_to_move)) {
-					process_pawn();
-				}
-			}
-			if (current.total_rolls() + 2 <= DICE_COUNT) { //Do castling
-				size_t new_index = current.append(KING).append(ROOK).encode();
-				std::vector<board> &destination = moves[new_index];
-				bool capture_found = king_capture_found[new_index];
-				if (!capture_found) {
-					if (current_to_move == WHITE) {
-						if (current_board.castling_mask & WHITE_KINGSIDE_CASTLE) {
-							if (is_empty(current_board.squares[0][5]) && is_empty(current_board.squares[0][6])) {
-								board new_board = current_board;
-								new_board.move_piece(0, 4, 0, 6);
-								new_board.move_piece(0, 7, 0, 5);
-								destination.push_back(new_board);
-							}
-						}
-						if (current_board.castling_mask & WHITE_QUEENSIDE_CASTLE) {
-							if (is_empty(current_board.squares[0][3]) && is_empty(current_board.squares[0][2]) && is_empty(current_board.squares[0][1])) {
-								board new_board = current_board;
-								new_board.move_piece(0, 4, 0, 2);
-								new_board.move_piece(0, 0, 0, 3);
-								destination.push_back(new_board);
-							}
-						}
-					}
-					else {
-						if (current_board.castling_mask & BLACK_KINGSIDE_CASTLE) {
-							if (is_empty(current_board.squares[7][5]) && is_empty(current_board.squares[7][6])) {
-								board new_board = current_board;
-								new_board.move_piece(7, 4, 7, 6);
-								new_board.move_piece(7, 7, 7, 5);
-								destination.push_back(new_board);
-							}
-						}
-						if (current_board.castling_mask & BLACK_QUEENSIDE_CASTLE) {
-							if (is_empty(current_board.squares[7][3]) && is_empty(current_board.squares[7][2]) && is_empty(current_board.squares[7][1])) {
-								board new_board = current_board;
-								new_board.move_piece(7, 4, 7, 2);
-								new_board.move_piece(7, 0, 7, 3);
-								destination.push_back(new_board);
-							}
-						}
-					}
+void board::build_layer(move_layers &layers, size_t dice_roll_id) const { //Builds the layer from all of its sources (strict subsets with one die less), recursively building those first
+	if (layers.built[dice_roll_id]) return;
+	layers.built[dice_roll_id] = true;
+	if (dice_roll_id == 0) {
+		board start = this->start_of_move();
+		layers.boards[dice_roll_id] = layers.arena.append(std::span<const board>(&start, 1));
+		return;
+	}
+	dice_roll current = dice_roll::decode(dice_roll_id);
+	for (uint8_t piece : PIECE_TYPES) {
+		if (!current.count[piece / 2 - 1]) continue;
+		size_t source = current.remove(piece).encode();
+		build_layer(layers, source);
+		if (layers.king_capture_found[source]) {
+			layers.king_capture_found[dice_roll_id] = true;
+			return;
+		}
+	}
+	INSTRUMENT_COUNT(LAYERS_BUILT, 1);
+	uint8_t reachable_en_passant = this->get_reachable_en_passant_first_heuristic(opponent(this->to_move));
+	std::vector<board> &destination = layer_buffer;
+	destination.clear();
+#ifdef DICE_CHESS_SORT_DEDUP
+	auto push = [&](const board &new_board) {
+		INSTRUMENT_COUNT(BOARDS_PUSHED, 1);
+		destination.push_back(new_board);
+	};
+#else
+	dedup_set.clear();
+	auto push = [&](const board &new_board) {
+		INSTRUMENT_COUNT(BOARDS_PUSHED, 1);
+		dedup_set.insert(destination, new_board);
+	};
+#endif
+	{
+		INSTRUMENT_STAGE(LAYER_EXPANSION);
+		for (uint8_t piece : PIECE_TYPES) {
+			if (!current.count[piece / 2 - 1]) continue;
+			for (const board &b : layers.boards[current.remove(piece).encode()]) {
+				INSTRUMENT_COUNT(SOURCE_BOARDS, 1);
+				if (for_each_move(b, piece, reachable_en_passant, push)) {
+					INSTRUMENT_COUNT(KING_CAPTURES, 1);
+					layers.king_capture_found[dice_roll_id] = true;
+					return;
 				}
 			}
 		}
 	}
-	for (size_t dice_roll_id = 0; dice_roll_id < DICE_ROLL_LENGTH ; ++dice_roll_id) {
-		dice_roll current = dice_roll::decode(dice_roll_id);
-		if (current.total_rolls() == DICE_COUNT) {
-			for (auto &x : moves[dice_roll_id]) x.finalize_en_passant();
-			std::sort(moves[dice_roll_id].begin(), moves[dice_roll_id].end());
-			moves[dice_roll_id].erase(std::unique(moves[dice_roll_id].begin(), moves[dice_roll_id].end()), moves[dice_roll_id].end());
-		}
+	if (current.count[KING / 2 - 1] && current.count[ROOK / 2 - 1]) {
+		INSTRUMENT_STAGE(CASTLING);
+		for (const board &b : layers.boards[current.remove(KING).remove(ROOK).encode()])
+			for_each_castling(b, push);
 	}
-	std::vector <bool> eliminated_en_passant(DICE_ROLL_LENGTH);
-	for (int dice_roll_id = DICE_ROLL_LENGTH - 1; dice_roll_id >= 0; --dice_roll_id) {
-		dice_roll current = dice_roll::decode(dice_roll_id);
-		if (current.total_rolls() > DICE_COUNT) {
-			continue;
-		}
-		if (king_capture_found[current.encode()]) {
-			continue;
+	if (current.total_rolls() == DICE_COUNT) { //Full rolls are never a source of another layer, so they can be finalized right away
+		{
+			INSTRUMENT_STAGE(FINALIZE_EN_PASSANT);
+			for (board &b : destination) b.finalize_en_passant();
 		}
-		std::vector<board> &current_moves = moves[current.encode()];
-		if (!current_moves.empty()) continue;
-		size_t current_total = current.total_rolls();
-		bool found_any = false;
-		std::vector<dice_roll> strict_subsets = current.strict_subsets();
-		for (int i = current_total - 1; i >= 0; --i) {
-			for (const dice_roll &subset : strict_subsets) {
-				if (subset.total_rolls() == i) {
-					assert(!king_capture_found[subset.encode()]);
-					if (!moves[subset.encode()].empty()) {
-						found_any = true;
-						if (!eliminated_en_passant[subset.encode()]) {
-							for (board &b : moves[subset.encode()]) b.finalize_en_passant();
-							eliminated_en_passant[subset.encode()] = true;
-						}
-						current_moves.insert(current_moves.end(), moves[subset.encode()].begin(), moves[subset.encode()].end()); //TODO: am I 100% sure those subsets are always disjoint(?)
-					}
-				}
+		deduplicate(destination);
+	}
+#ifdef DICE_CHESS_SORT_DEDUP
+	else deduplicate(destination);
+#endif
+	INSTRUMENT_COUNT(BOARDS_STORED, destination.size());
+	layers.boards[dice_roll_id] = layers.arena.append(destination);
+}
+
+static std::span<const board> finalized_layer(move_layers &layers, size_t dice_roll_id) {
+	if (!layers.finalized_built[dice_roll_id]) {
+		layers.finalized_built[dice_roll_id] = true;
+		std::span<board> copy = layers.arena.append(layers.boards[dice_roll_id]);
+		INSTRUMENT_STAGE(FINALIZE_EN_PASSANT);
+		for (board &b : copy) b.finalize_en_passant();
+		layers.finalized[dice_roll_id] = copy;
+	}
+	return layers.finalized[dice_roll_id];
+}
+
+move_range board::fallback_moves(move_layers &layers, size_t dice_roll_id) const { //No way to use all the dice, use the biggest subsets that can be used instead
+	INSTRUMENT_COUNT(FALLBACKS, 1);
+	INSTRUMENT_STAGE(FALLBACK);
+	dice_roll current = dice_roll::decode(dice_roll_id);
+	std::vector<dice_roll> strict_subsets = current.strict_subsets();
+	for (int i = current.total_rolls() - 1; i >= 0; --i) {
+		std::vector<size_t> sources;
+		for (const dice_roll &subset : strict_subsets) {
+			if (subset.total_rolls() == i) {
+				assert(layers.built[subset.encode()] && !layers.king_capture_found[subset.encode()]);
+				if (!layers.boards[subset.encode()].empty()) sources.push_back(subset.encode());
 			}
-			if (found_any) break;
 		}
-		assert(!current_moves.empty());
+		if (sources.empty()) continue;
+		move_range ret;
+		for (size_t source : sources) ret.append(finalized_layer(layers, source)); //TODO: am I 100% sure those subsets are always disjoint(?)
+		return ret;
 	}
+	assert(false);
+	return {};
+}
 
-	return moves;
+static const std::array<std::bitset<DICE_ROLL_LENGTH>, DICE_ROLL_LENGTH> superset_masks = []{ //superset_masks[x] has every dice roll containing x set (including x itself)
+	std::array<std::bitset<DICE_ROLL_LENGTH>, DICE_ROLL_LENGTH> ret;
+	for (size_t dice_roll_id = 0; dice_roll_id < DICE_ROLL_LENGTH; ++dice_roll_id) {
+		ret[dice_roll_id][dice_roll_id] = true;
+		for (const dice_roll &subset : dice_roll::decode(dice_roll_id).strict_subsets()) ret[subset.encode()][dice_roll_id] = true;
+	}
+	return ret;
+}();
+
+static const std::array<std::array<uint8_t, PIECES_TYPES_COUNT>, DICE_ROLL_LENGTH> appended_ids = []{ //appended_ids[x][piece / 2 - 1] == x.append(piece).encode(), only meaningful for partial x
+	std::array<std::array<uint8_t, PIECES_TYPES_COUNT>, DICE_ROLL_LENGTH> ret{};
+	for (const dice_roll &dice : partial_dice_rolls)
+		for (uint8_t piece : PIECE_TYPES)
+			ret[dice.encode()][piece / 2 - 1] = dice.append(piece).encode();
+	return ret;
+}();
+
+std::bitset<DICE_ROLL_LENGTH> board::king_capture_rolls() const {
+	INSTRUMENT_COUNT(KING_CAPTURE_ORACLE_CALLS, 1);
+	INSTRUMENT_STAGE(KING_CAPTURE_ORACLE);
+	std::bitset<DICE_ROLL_LENGTH> ret;
+	uint8_t reachable_en_passant = this->get_reachable_en_passant_first_heuristic(opponent(this->to_move));
+	auto search = [&](auto &&self, const board &b, size_t used_id, int dice_left) -> void { //Depth first over dice orders, nothing is stored and the last die is only checked for attacks on the king
+		uint8_t attackers = this->king_attacker_types(b);
+		for (uint8_t piece : PIECE_TYPES) {
+			size_t next_id = appended_ids[used_id][piece / 2 - 1];
+			if ((superset_masks[next_id] & ~ret).none()) continue; //Every roll this could lead to already captures the king
+			if ((attackers >> (piece / 2 - 1)) & 1) {
+				ret |= superset_masks[next_id];
+				continue;
+			}
+			if (dice_left > 1) this->for_each_move(b, piece, reachable_en_passant, [&](const board &new_board) {self(self, new_board, next_id, dice_left - 1);});
+		}
+		if (dice_left >= 3) { //Castling uses up two dice, so only the last one is left for an attack check
+			size_t next_id = appended_ids[appended_ids[used_id][KING / 2 - 1]][ROOK / 2 - 1];
+			if ((superset_masks[next_id] & ~ret).any()) this->for_each_castling(b, [&](const board &new_board) {self(self, new_board, next_id, dice_left - 2);});
+		}
+	};
+	search(search, this->start_of_move(), 0, DICE_COUNT);
+	return ret;
+}
+
+movelist board::generate_moves() const {
+	movelist ret(*this);
+	for (const dice_roll &dice : full_and_partial_dice_rolls) ret.get_moves(dice);
+	return ret;
+}
+
+movelist board::generate_moves_lazily() const {
+	return movelist(*this);
 }
 
 std::vector<dice_roll> make_rolls_with(int low, int high) { //TODO: Maybe this can be replaced with just iterating through numbers in range and decoding them on the fly (?)
@@ -736,38 +945,109 @@ std::vector<dice_roll> make_rolls_with(int low, int high) { //TODO: Maybe this c
 }
 	
 void board::touch_castling(int x, int y) {
+	if (!this->castling_mask) return;
+	uint8_t mask = this->castling_mask;
 	if (x == 0) {
-		if (y == 0) this->castling_mask &=~ WHITE_QUEENSIDE_CASTLE;
-		if (y == 4) this->castling_mask &=~ (WHITE_QUEENSIDE_CASTLE | WHITE_KINGSIDE_CASTLE);
-		if (y == 7) this->castling_mask &=~ WHITE_KINGSIDE_CASTLE;
+		if (y == 0) mask &=~ WHITE_QUEENSIDE_CASTLE;
+		if (y == 4) mask &=~ (WHITE_QUEENSIDE_CASTLE | WHITE_KINGSIDE_CASTLE);
+		if (y == 7) mask &=~ WHITE_KINGSIDE_CASTLE;
 	}
 	if (x == 7) {
-		if (y == 0) this->castling_mask &=~ BLACK_QUEENSIDE_CASTLE;
-		if (y == 4) this->castling_mask &=~ (BLACK_QUEENSIDE_CASTLE | BLACK_KINGSIDE_CASTLE);
-		if (y == 7) this->castling_mask &=~ BLACK_KINGSIDE_CASTLE;
+		if (y == 0) mask &=~ BLACK_QUEENSIDE_CASTLE;
+		if (y == 4) mask &=~ (BLACK_QUEENSIDE_CASTLE | BLACK_KINGSIDE_CASTLE);
+		if (y == 7) mask &=~ BLACK_KINGSIDE_CASTLE;
+	}
+	set_castling_mask(mask);
+}
+
+uint8_t board::castling_rights_in_place() const {
+	uint8_t ret = 0;
+	for (uint8_t player : {WHITE, BLACK}) {
+		const int rank = player == WHITE ? 0 : BOARD_HEIGHT - 1;
+		if (this->squares[rank][4] != make_piece(KING, player)) continue;
+		if (this->squares[rank][7] == make_piece(ROOK, player)) ret |= player == WHITE ? WHITE_KINGSIDE_CASTLE : BLACK_KINGSIDE_CASTLE;
+		if (this->squares[rank][0] == make_piece(ROOK, player)) ret |= player == WHITE ? WHITE_QUEENSIDE_CASTLE : BLACK_QUEENSIDE_CASTLE;
 	}
+	return ret & this->castling_mask;
+}
+
+void board::set_castling_mask(uint8_t mask) {
+	this->key ^= zobrist.castling[this->castling_mask] ^ zobrist.castling[mask];
+	this->castling_mask = mask;
+}
+
+void board::set_en_passant_mask(uint8_t mask) {
+	this->key ^= zobrist.en_passant[this->en_passant_mask] ^ zobrist.en_passant[mask];
+	this->en_passant_mask = mask;
 }
 
 void board::add_en_passant(int x, uint8_t reachable) {
-	(this->en_passant_mask |= (1 << x)) &= reachable;
+	set_en_passant_mask((this->en_passant_mask | (1 << x)) & reachable);
 }
 void board::remove_en_passant(int x) {
-	this->en_passant_mask &=~ (1 << x);
+	set_en_passant_mask(this->en_passant_mask & ~(1 << x));
+}
+
+void board::set_square(int x, int y, uint8_t piece) {
+	bitboard bit = square_bit(x, y);
+	uint8_t old = this->squares[x][y];
+	if (!is_empty(old)) {
+		this->piece_bitboards[to_raw_piece(old) / 2 - 1] &=~ bit;
+		this->player_bitboards[get_player(old)] &=~ bit;
+		this->key ^= zobrist.piece_square[old][square_index(x, y)];
+	}
+	this->squares[x][y] = piece;
+	if (!is_empty(piece)) {
+		this->piece_bitboards[to_raw_piece(piece) / 2 - 1] |= bit;
+		this->player_bitboards[get_player(piece)] |= bit;
+		this->key ^= zobrist.piece_square[piece][square_index(x, y)];
+	}
+}
+
+void board::recompute_bitboards() {
+	this->piece_bitboards = {};
+	this->player_bitboards = {};
+	for (int i = 0; i < BOARD_HEIGHT; ++i) {
+		for (int j = 0; j < BOARD_WIDTH; ++j) {
+			if (!is_empty(this->squares[i][j])) {
+				this->piece_bitboards[to_raw_piece(this->squares[i][j]) / 2 - 1] |= square_bit(i, j);
+				this->player_bitboards[get_player(this->squares[i][j])] |= square_bit(i, j);
+			}
+		}
+	}
+}
+
+void board::recompute_hash() {
+	this->key = zobrist.castling[this->castling_mask] ^ zobrist.en_passant[this->en_passant_mask] ^ (this->to_move == BLACK ? zobrist.black_to_move : 0);
+	for (int i = 0; i < BOARD_HEIGHT; ++i)
+		for (int j = 0; j < BOARD_WIDTH; ++j)
+			if (!is_empty(this->squares[i][j]))
+				this->key ^= zobrist.piece_square[this->squares[i][j]][square_index(i, j)];
 }
 
 void board::move_piece(int from_x, int from_y, int to_x, int to_y) {
 	touch_castling(from_x, from_y);
 	touch_castling(to_x, to_y);
-	this->squares[to_x][to_y] = this->squares[from_x][from_y];
+	const uint8_t piece = this->squares[from_x][from_y], captured = this->squares[to_x][to_y];
+	const bitboard from_bit = square_bit(from_x, from_y), to_bit = square_bit(to_x, to_y);
+	if (!is_empty(captured)) {
+		this->piece_bitboards[to_raw_piece(captured) / 2 - 1] &=~ to_bit;
+		this->player_bitboards[get_player(captured)] &=~ to_bit;
+		this->key ^= zobrist.piece_square[captured][square_index(to_x, to_y)];
+	}
+	this->piece_bitboards[to_raw_piece(piece) / 2 - 1] ^= from_bit | to_bit;
+	this->player_bitboards[get_player(piece)] ^= from_bit | to_bit;
+	this->key ^= zobrist.piece_square[piece][square_index(from_x, from_y)] ^ zobrist.piece_square[piece][square_index(to_x, to_y)];
+	this->squares[to_x][to_y] = piece;
 	this->squares[from_x][from_y] = EMPTY;
 }
 void board::clear_square(int x, int y) {
 	touch_castling(x, y); //TODO: this can be optimized sometimes, you're not depriving anyone of castling after an en-passant for example
-	this->squares[x][y] = EMPTY;
+	set_square(x, y, EMPTY);
 }
 void board::put_piece(int x, int y, uint8_t piece) {
 	touch_castling(x, y);
-	this->squares[x][y] = piece;
+	set_square(x, y, piece);
 }
 
 void board::dump(std::ostream &o) const {
@@ -814,7 +1094,7 @@ int get_screen_width() {
 	return std::stoi(x);
 }
 
-void bulk_dump_boards(const std::vector<board> &boards, std::ostream &o) {
+void bulk_dump_boards(const move_range &boards, std::ostream &o) {
 	const size_t SPOT_WIDTH = 21, CHUNK = get_screen_width() / SPOT_WIDTH;
 	auto go = [&](size_t begin, size_t end) {
 		std::vector<std::vector<std::string> > rows;
@@ -899,6 +1179,8 @@ void board::shift_in_place(int x) { //square (i, j) -> (i, j + x)
 		this->en_passant_mask >>= -x;
 	}
 	//else pass;
+	recompute_bitboards();
+	recompute_hash();
 }
 
 std::vector <int> board::get_shift_range() const {
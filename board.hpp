@@ -1,3 +1,5 @@
+#ifndef BOARD_H
+#define BOARD_H
 #include <climits>
 #include <array>
 #include <cstdint>
@@ -5,6 +7,14 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <tuple>
+#include <bitset>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <cassert>
+#include <iterator>
+#include "random.hpp"
 const int PIECES_TYPES_COUNT = 6, DICE_COUNT = 3;
 const int BOARD_WIDTH = 8, BOARD_HEIGHT = 8;
 const uint8_t EMPTY = 0, WHITE = 0, BLACK = 1, PAWN = 2, KNIGHT = 4, BISHOP = 6, ROOK = 8, QUEEN = 10, KING = 12;
@@ -69,50 +79,80 @@ public:
 	static dice_roll decode(int); 
 	int total_rolls() const;
 	dice_roll append(uint8_t piece) const;
+	dice_roll remove(uint8_t piece) const;
 	std::vector<dice_roll> strict_subsets() const;
 	dice_roll& operator=(const dice_roll& other) = default;
 	int combinations() const;
-	static dice_roll roll(std::mt19937 &rng);
+	template <class RNG> static dice_roll roll(RNG &rng) { ///< One draw per die
+		dice_roll ret = {};
+		for (int _ = 0; _ < DICE_COUNT; ++_) ret.count[random_below(rng, PIECES_TYPES_COUNT)]++;
+		return ret;
+	}
+	template <class RNG> static dice_roll roll_at_once(RNG &rng) { ///< Same distribution as roll(), all the dice read from one draw among OMEGA
+		dice_roll ret = {};
+		for (int x = random_below(rng, OMEGA), _ = 0; _ < DICE_COUNT; ++_, x /= PIECES_TYPES_COUNT) ret.count[x % PIECES_TYPES_COUNT]++;
+		return ret;
+	}
 	auto operator<=>(const dice_roll &oth) const = default;
 };
 
 dice_roll parse_dice_roll(const std::string &s);
+std::optional<dice_roll> try_parse_dice_roll(std::string_view s); ///< Without asserts, nullopt unless s is DICE_COUNT piece letters, a full roll
 
 std::vector<dice_roll> make_rolls_with(int low, int high);
 
+constexpr size_t FULL_DICE_ROLLS_COUNT = pascal[PIECES_TYPES_COUNT + DICE_COUNT - 1][DICE_COUNT]; ///< full_dice_rolls.size(), usable as an array size
 const std::vector<dice_roll> full_dice_rolls = make_rolls_with(3, 3);
 const std::vector<dice_roll> partial_dice_rolls = make_rolls_with(0, 2);
 const std::vector<dice_roll> full_and_partial_dice_rolls = make_rolls_with(0, 3);
 
 std::ostream &operator<<(std::ostream &o, const dice_roll &dice);
 
-class movelist {
-	std::array<std::vector<board>, DICE_ROLL_LENGTH> moves;
-
-public:
-	movelist(const std::array<std::vector<board>, DICE_ROLL_LENGTH> &moves_);
-	movelist(std::array<std::vector<board>, DICE_ROLL_LENGTH> &&moves_);
-	const std::vector<board>& get_moves(const dice_roll &x) const; //Keep as a separate class so can be done lazily or anything alike in the future, probably replace to return some wrapper around possibly multiple vectors
-																																 //(use when there's no way to move all 3 pieces, but there are some to move a subset and those strict_subsets can be only stored once)
-	int count_winning_on_the_spot() const;
-};
+class movelist;
+struct packed_board;
 
 class partial_movelist {
 	
 };
 
+struct move_layers;
+class move_range;
+
 using square_t = uint8_t;
+using bitboard = uint64_t;
+constexpr int square_index(int x, int y) {return x * BOARD_WIDTH + y;}
+constexpr bitboard square_bit(int x, int y) {return bitboard(1) << square_index(x, y);}
+constexpr bitboard mirror_files(bitboard x) { //Reverses the bits of every rank, a horizontal mirror image
+	x = (x >> 1 & 0x5555555555555555) | (x & 0x5555555555555555) << 1;
+	x = (x >> 2 & 0x3333333333333333) | (x & 0x3333333333333333) << 2;
+	return (x >> 4 & 0x0f0f0f0f0f0f0f0f) | (x & 0x0f0f0f0f0f0f0f0f) << 4;
+}
 constexpr bool is_empty(square_t x) {return x == EMPTY;}
 constexpr bool is_players(square_t x, uint8_t player) {return (x & 1) == player;} //TODO: what should this return when x is empty (?), so far just don't use it with this value at all
 constexpr uint8_t to_raw_piece(square_t x) {return x &~1;}
 constexpr uint8_t make_piece(uint8_t piece, uint8_t player) {return piece | player;}
+class board;
 board parse_fen(const std::string &x);
+enum class fen_error : uint8_t {NONE, FIELD_COUNT, RANK_COUNT, RANK_LENGTH, PIECE, TO_MOVE, CASTLING, EN_PASSANT, KING_COUNT, PAWN_RANK, PIECE_COUNT, CASTLING_PIECES};
+const char *fen_error_message(fen_error error);
+fen_error try_parse_fen(std::string_view fen, board &out); ///< Allocation free and without asserts, rejects what check_position() rejects, out is only meaningful when NONE is returned, move counters (if any) are ignored
+fen_error check_position(const board &b); ///< NONE when move generation and packed_board can handle b: one king per side, no pawns on the first or last rank, at most packed_board::MAX_PIECES pieces, castling rights only with their king and rook
+constexpr size_t MAX_FEN_LENGTH = 128; ///< Longest board::write_fen output, 8 full ranks and every en passant square fit
 class board {
 	std::array<std::array<uint8_t, BOARD_WIDTH>, BOARD_HEIGHT> squares; /// <Access as squares[rank][file]
 	uint8_t castling_mask;
 	uint8_t to_move;
 	uint8_t en_passant_mask;
+	std::array<bitboard, PIECES_TYPES_COUNT> piece_bitboards; /// <Indexed by raw piece / 2 - 1, kept in sync with squares
+	std::array<bitboard, 2> player_bitboards;
+	hash_type key; /// <Zobrist key of the whole position, updated incrementally
+	void set_square(int x, int y, uint8_t piece);
+	void recompute_bitboards();
+	void recompute_hash();
+	void set_castling_mask(uint8_t mask);
+	void set_en_passant_mask(uint8_t mask);
 	void touch_castling(int x, int y);
+	uint8_t castling_rights_in_place() const; ///< Those of castling_mask whose king and rook are on their starting squares, the only ones castling can use
 	void add_en_passant(int x, uint8_t reachable);
 	void remove_en_passant(int x);
 	uint8_t get_reachable_en_passant_first_heuristic(uint8_t player) const;
@@ -121,26 +161,148 @@ class board {
 	void clear_square(int x, int y);
 	void put_piece(int x, int y, uint8_t piece);
 	int min_moves_to_capture_king_with_pawns(uint8_t player) const;
+	template <class F> bool for_each_move(const board &b, uint8_t piece, uint8_t reachable_en_passant, F &&push) const;
+	template <class F> void for_each_castling(const board &b, F &&push) const;
+	uint8_t king_attacker_types(const board &b) const;
+	board start_of_move() const;
+	void build_layer(move_layers &layers, size_t dice_roll_id) const;
+	move_range fallback_moves(move_layers &layers, size_t dice_roll_id) const;
+	friend class movelist;
+	friend struct packed_board;
 public:
 	movelist generate_moves() const;
+	movelist generate_moves_lazily() const;
+	std::bitset<DICE_ROLL_LENGTH> king_capture_rolls() const; /// <Dice rolls (full and partial) that allow capturing the king, same as the empty rolls of generate_moves() but without generating any positions
 	partial_movelist generate_partial_moves() const;
 	void dump(std::ostream &o) const;
-	friend board parse_fen(const std::string &x);
-	auto operator<=>(const board &oth) const = default;
+	friend fen_error try_parse_fen(std::string_view fen, board &out);
+	friend fen_error check_position(const board &b);
+	auto operator<=>(const board &oth) const { //squares are fully determined by the bitboards, comparing those is much cheaper
+		return std::tie(piece_bitboards, player_bitboards, castling_mask, to_move, en_passant_mask) <=> std::tie(oth.piece_bitboards, oth.player_bitboards, oth.castling_mask, oth.to_move, oth.en_passant_mask);
+	}
+	bool operator==(const board &oth) const {
+		return std::tie(piece_bitboards, player_bitboards, castling_mask, to_move, en_passant_mask) == std::tie(oth.piece_bitboards, oth.player_bitboards, oth.castling_mask, oth.to_move, oth.en_passant_mask);
+	}
 	std::string fen() const;
+	size_t write_fen(char *out) const; /// <Writes at most MAX_FEN_LENGTH characters (no terminating zero) and returns how many, allocation free
 	uint8_t get_to_move() const;
 	void flip_in_place();
 	board flip() const;
 	uint8_t get_castling_mask() const;
 	uint8_t get_en_passant_mask() const;
 	void flip_horizontally_in_place();
+	board canonical() const; /// <Smallest of the positions equivalent to this one under flip() and (without castling rights) flip_horizontally_in_place(), they all have the same moves up to that symmetry
 	void finalize_en_passant();
 	void shift_in_place(int x);
 	std::vector <int> get_shift_range() const;
 	std::pair <int, int> get_king_position(uint8_t player) const;
+	bitboard pieces(uint8_t raw_piece, uint8_t player) const {return this->piece_bitboards[raw_piece / 2 - 1] & this->player_bitboards[player];}
+	bitboard occupied_by(uint8_t player) const {return this->player_bitboards[player];}
+	bitboard occupied() const {return this->player_bitboards[WHITE] | this->player_bitboards[BLACK];}
+	hash_type hash() const {return this->key;}
 };
 
 
-void bulk_dump_boards(const std::vector<board> &, std::ostream &o);
-void bulk_dump_boards_with_annotations(const std::vector<board> &boards, const std::vector<std::string> &annotations, std::ostream &o);
+/// Bump allocator for positions, blocks are never reallocated so ranges handed out stay valid as long as the arena (also when it's moved)
+/// Blocks of destroyed arenas are kept per thread and reused by the next ones, so steady state move generation doesn't allocate
+class board_arena {
+	std::vector<std::vector<board>> blocks;
+public:
+	board_arena() = default;
+	board_arena(board_arena &&) = default;
+	board_arena &operator=(board_arena &&) = default;
+	~board_arena();
+	std::span<board> append(std::span<const board> boards); /// <Copies boards (which may live in this arena) into one contiguous range
+};
+
+struct move_layers {
+	board_arena arena;
+	std::array<std::span<const board>, DICE_ROLL_LENGTH> boards; /// <Positions reachable using exactly the given dice, en passant finalized only for full rolls
+	std::array<bool, DICE_ROLL_LENGTH> king_capture_found = {};
+	std::bitset<DICE_ROLL_LENGTH> built;
+	std::array<std::span<const board>, DICE_ROLL_LENGTH> finalized; /// <En passant finalized copies of partial layers, made when a roll falls back to them
+	std::bitset<DICE_ROLL_LENGTH> finalized_built;
+};
 
+/// Positions of a few ranges chained together without copying, what movelist::get_moves returns
+/// A roll without any legal move falls back to all the largest subsets of it that have one, those are shared between rolls this way
+class move_range {
+public:
+	static constexpr int MAX_PARTS = pascal[DICE_COUNT][DICE_COUNT / 2]; /// <Most subsets of one size a dice roll can have
+private:
+	std::array<std::span<const board>, MAX_PARTS> parts;
+	int parts_count = 0;
+	size_t total = 0;
+public:
+	class iterator {
+		const move_range *range = nullptr;
+		int part = 0;
+		size_t offset = 0;
+		friend class move_range;
+		iterator(const move_range *range, int part) : range(range), part(part) {}
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = board;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const board *;
+		using reference = const board &;
+		iterator() = default;
+		reference operator*() const {return range->parts[part][offset];}
+		pointer operator->() const {return &range->parts[part][offset];}
+		iterator &operator++() {
+			if (++offset == range->parts[part].size()) {
+				offset = 0;
+				part++;
+			}
+			return *this;
+		}
+		iterator operator++(int) {
+			iterator ret = *this;
+			++*this;
+			return ret;
+		}
+		bool operator==(const iterator &oth) const {return part == oth.part && offset == oth.offset;}
+	};
+
+	move_range() = default;
+	move_range(std::span<const board> part) {this->append(part);}
+	move_range(const std::vector<board> &boards) : move_range(std::span<const board>(boards)) {}
+	void append(std::span<const board> part) {
+		if (part.empty()) return;
+		assert(this->parts_count < MAX_PARTS);
+		this->parts[this->parts_count++] = part;
+		this->total += part.size();
+	}
+	size_t size() const {return this->total;}
+	bool empty() const {return this->total == 0;}
+	const board &operator[](size_t i) const {
+		int part = 0;
+		while (i >= this->parts[part].size()) i -= this->parts[part++].size();
+		return this->parts[part][i];
+	}
+	iterator begin() const {return iterator(this, 0);}
+	iterator end() const {return iterator(this, this->parts_count);}
+};
+
+class movelist {
+	board origin;
+	mutable move_layers layers;
+	mutable std::array<move_range, DICE_ROLL_LENGTH> moves; /// <Into layers.arena
+	mutable std::bitset<DICE_ROLL_LENGTH> computed; /// <Rolls are generated on their first get_moves
+	mutable std::optional<std::bitset<DICE_ROLL_LENGTH>> king_captures_mask; /// <From board::king_capture_rolls, filled on first use
+	const std::bitset<DICE_ROLL_LENGTH> &king_captures() const;
+	void compute(size_t dice_roll_id) const;
+
+public:
+	movelist(const std::array<std::vector<board>, DICE_ROLL_LENGTH> &moves_);
+	explicit movelist(const board &origin);
+	movelist(movelist &&) = default;
+	movelist &operator=(movelist &&) = default;
+	const move_range &get_moves(const dice_roll &x) const &;
+	const move_range &get_moves(const dice_roll &x) && = delete; ///< The range points into this movelist's arena, name the movelist first
+	int count_winning_on_the_spot() const;
+};
+
+void bulk_dump_boards(const move_range &boards, std::ostream &o);
+void bulk_dump_boards_with_annotations(const std::vector<board> &boards, const std::vector<std::string> &annotations, std::ostream &o);
+#endif
@@ -0,0 +1,75 @@
+#ifndef BOARD_SET_H
+#define BOARD_SET_H
+#include <algorithm>
+#include <vector>
+#include "board.hpp"
+
+/// Open addressing set of positions living in an external vector, keyed by board::hash(), so duplicates are rejected before being stored.
+/// Slots are stamped with an epoch, clear() is O(1) and the same table can be reused by consecutive generate_moves calls on one thread.
+class board_set {
+	struct slot {
+		hash_type hash;
+		uint32_t index;
+		uint32_t epoch;
+	};
+	std::vector<slot> slots;
+	uint32_t epoch = 1;
+	size_t count = 0;
+
+	slot &find(const std::vector<board> &boards, const board &b, hash_type hash) {
+		size_t mask = slots.size() - 1;
+		for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+			slot &s = slots[i];
+			if (s.epoch != epoch || (s.hash == hash && boards[s.index] == b)) return s;
+		}
+	}
+
+	void grow(const std::vector<board> &boards) {
+		slots.assign(std::max<size_t>(64, 2 * slots.size()), slot{0, 0, 0});
+		epoch = 1;
+		for (size_t i = 0; i < boards.size(); ++i) {
+			hash_type hash = boards[i].hash();
+			find(boards, boards[i], hash) = {hash, uint32_t(i), epoch};
+		}
+	}
+
+public:
+	void clear() {
+		count = 0;
+		if (++epoch == 0) {
+			for (slot &s : slots) s.epoch = 0;
+			epoch = 1;
+		}
+	}
+
+	/// Appends b to boards unless an equal position is already there, boards must only ever be modified through this set (or cleared together with it)
+	bool insert(std::vector<board> &boards, const board &b) {
+		if (2 * (count + 1) > slots.size()) grow(boards);
+		hash_type hash = b.hash();
+		slot &s = find(boards, b, hash);
+		if (s.epoch == epoch) return false;
+		s = {hash, uint32_t(boards.size()), epoch};
+		boards.push_back(b);
+		count++;
+		return true;
+	}
+
+	/// Removes duplicates from boards (e.g. after the positions were modified in place), keeping first occurrences in order, and makes the set track the result
+	void deduplicate(std::vector<board> &boards) {
+		clear();
+		while (2 * boards.size() > slots.size()) grow({});
+		size_t kept = 0;
+		for (size_t i = 0; i < boards.size(); ++i) {
+			hash_type hash = boards[i].hash();
+			slot &s = find(boards, boards[i], hash);
+			if (s.epoch == epoch) continue;
+			s = {hash, uint32_t(kept), epoch};
+			if (kept != i) boards[kept] = boards[i];
+			kept++;
+		}
+		boards.resize(kept);
+		count = kept;
+	}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "exact_playout.hpp"
+#include "playout_cache.hpp"
+
+exact_playout::outcome exact_playout::evaluate(const board &b, int plies) {
+	if (plies == 0) return {};
+	if (this->tables)
+		if (std::optional<tablebase::value> exact = this->tables->probe(b)) return {exact->win, exact->loss, 1 - exact->win - exact->loss};
+	if ((int)this->memo.size() < plies) this->memo.resize(plies);
+	const hash_type key = b.canonical().hash(); //Outcomes are from the side to move's point of view, the same for symmetric positions
+	if (auto found = this->memo[plies - 1].find(key); found != this->memo[plies - 1].end()) return found->second;
+
+	outcome ret = {0, 0, 0};
+	if (plies == 1) { //Only the king captures count, no need for the moves
+		const uint64_t king_captures = full_king_capture_rolls(b);
+		for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+			const double probability = full_dice_rolls[i].combinations() / (double)OMEGA;
+			if (king_captures >> i & 1) ret.won += probability;
+			else ret.still_playing += probability;
+		}
+	}
+	else {
+		movelist moves = b.generate_moves();
+		for (const dice_roll &dice : full_dice_rolls) {
+			const double probability = dice.combinations() / (double)OMEGA;
+			const move_range &roll_moves = moves.get_moves(dice);
+			if (roll_moves.empty()) {
+				ret.won += probability;
+				continue;
+			}
+			const double weight = probability / roll_moves.size();
+			for (const board &child : roll_moves) {
+				const outcome child_outcome = this->evaluate(child, plies - 1);
+				ret.won += weight * child_outcome.lost;
+				ret.lost += weight * child_outcome.won;
+				ret.still_playing += weight * child_outcome.still_playing;
+			}
+		}
+	}
+	this->memo[plies - 1][key] = ret;
+	return ret;
+}
+
+size_t exact_playout::positions() const {
+	size_t ret = 0;
+	for (const auto &depth : this->memo) ret += depth.size();
+	return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef EXACT_PLAYOUT_H
+#define EXACT_PLAYOUT_H
+#include <unordered_map>
+#include <vector>
+#include "board.hpp"
+#include "tablebase.hpp"
+
+/// Exact distribution of the results of monte-carlo playouts cut after a number of plies, what the sampler estimates:
+/// every full roll is followed with its probability and, when it doesn't capture the king, every move uniformly, as the playouts pick them.
+/// Results are memoised by board::canonical() hash and plies left, the work is the number of distinct positions reached rather than of paths to them.
+class exact_playout {
+public:
+	struct outcome { ///< From the point of view of the side to move, the three add up to 1
+		double won = 0;
+		double lost = 0;
+		double still_playing = 1;
+	};
+
+	explicit exact_playout(const tablebase *tables = nullptr) : tables(tables) {} ///< Positions the tablebase covers end with their exact values, as in the playouts
+	outcome evaluate(const board &b, int plies);
+	size_t positions() const; ///< Memoised so far, over all depths
+
+private:
+	const tablebase *tables;
+	std::vector<std::unordered_map<hash_type, outcome>> memo; ///< By plies left
+};
+
+#endif
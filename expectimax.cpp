@@ -0,0 +1,161 @@
+#include "expectimax.hpp"
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+
+const double MATERIAL_SCALE = 8; ///< Material difference at which the static evaluation gives the side ahead ~73%
+const int TIME_CHECK_INTERVAL = 256; ///< Chance nodes between looks at the clock
+
+expectimax_search::expectimax_search(int transposition_table_bits, bool star_pruning) : table(size_t(1) << transposition_table_bits), star_pruning(star_pruning) {}
+
+double expectimax_search::evaluate(const board &b) {
+	static const int piece_values[] = {1, 3, 3, 5, 9, 0}; //Indexed by piece / 2 - 1
+	const uint8_t player = b.get_to_move();
+	int difference = 0;
+	for (uint8_t piece : PIECE_TYPES)
+		difference += piece_values[piece / 2 - 1] * (__builtin_popcountll(b.pieces(piece, player)) - __builtin_popcountll(b.pieces(piece, opponent(player))));
+	return 1 / (1 + std::exp(-difference / MATERIAL_SCALE));
+}
+
+bool expectimax_search::out_of_time() {
+	if (!this->stopped && this->deadline_active && this->nodes % TIME_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() >= this->deadline)
+		this->stopped = true;
+	return this->stopped;
+}
+
+double expectimax_search::guess(const board &b) const { //Cheap estimate for move ordering, a stored value of any depth or the static evaluation
+	const transposition_entry &entry = this->table[b.hash() & (this->table.size() - 1)];
+	if (entry.key == b.hash() && entry.depth >= 0) return entry.value;
+	return evaluate(b);
+}
+
+std::vector<size_t> expectimax_search::move_order(const move_range &moves) const { //Most promising for the side that moved first
+	std::vector<std::pair<double, size_t>> keyed(moves.size());
+	for (size_t i = 0; i < moves.size(); ++i) keyed[i] = {this->guess(moves[i]), i};
+	std::sort(keyed.begin(), keyed.end());
+	std::vector<size_t> ret(moves.size());
+	for (size_t i = 0; i < moves.size(); ++i) ret[i] = keyed[i].second;
+	return ret;
+}
+
+double expectimax_search::roll_value(const move_range &moves, int depth, double alpha, double beta, const board **best) { //Value of the roll for the side that rolled it, alpha when no move is better than that, moves empty means king capture
+	if (moves.empty()) return 1;
+	std::vector<size_t> order = this->move_order(moves);
+	double ret = this->star_pruning ? alpha : 0;
+	for (size_t i : order) {
+		double child_alpha = this->star_pruning ? 1 - beta : 0, child_beta = this->star_pruning ? 1 - ret : 1;
+		double child_value = this->chance_value(moves[i], depth - 1, child_alpha, child_beta);
+		if (this->stopped) return 0;
+		if (child_value >= child_beta || 1 - child_value <= ret) continue; //Not better than what we have (checked on the child's value, 1 - (1 - x) needn't be x)
+		ret = 1 - child_value;
+		if (best) *best = &moves[i];
+		if (this->star_pruning && ret >= beta) break;
+	}
+	if (best && !*best) *best = &moves[order[0]]; //Everything is equally lost
+	return ret;
+}
+
+double expectimax_search::chance_value(const board &b, int depth, double alpha, double beta) { //Fail-hard, alpha when the value is <= alpha and beta when it's >= beta
+	if (this->tables)
+		if (std::optional<tablebase::value> exact = this->tables->probe(b)) return std::clamp(exact->score(), alpha, beta);
+	if (depth == 0) return evaluate(b);
+	this->nodes++;
+	if (this->out_of_time()) return 0;
+	transposition_entry &entry = this->table[b.hash() & (this->table.size() - 1)];
+	if (entry.key == b.hash() && entry.depth >= depth) {
+		if (entry.bound == EXACT) return entry.value;
+		if (entry.bound == LOWER && entry.value >= beta) return beta;
+		if (entry.bound == UPPER && entry.value <= alpha) return alpha;
+	}
+	auto store = [&](double value, uint8_t bound) {
+		if (entry.depth <= depth) entry = {b.hash(), (float)value, (int8_t)depth, bound}; //Deeper results are worth more, keep them over shallow ones
+	};
+	movelist moves = b.generate_moves_lazily();
+	std::array<double, FULL_DICE_ROLLS_COUNT> probability, lower; //lower[i] is a proven lower bound for the value of the i-th roll
+	double lower_sum = 0;
+	for (size_t i = 0; i < FULL_DICE_ROLLS_COUNT; ++i) {
+		probability[i] = full_dice_rolls[i].combinations() / (double)OMEGA;
+		lower[i] = 0;
+	}
+
+	if (this->star_pruning) { //Star2: probe one move per roll, any move is a lower bound for the roll, maybe enough for a cutoff already
+		for (size_t i = 0; i < FULL_DICE_ROLLS_COUNT; ++i) {
+			const move_range &roll_moves = moves.get_moves(full_dice_rolls[i]);
+			if (roll_moves.empty()) lower[i] = 1;
+			else {
+				double needed = std::min(1.0, (beta - lower_sum) / probability[i]); //Roll value that would prove value >= beta
+				lower[i] = 1 - this->chance_value(roll_moves[this->move_order(roll_moves)[0]], depth - 1, 1 - needed, 1);
+				if (this->stopped) return 0;
+			}
+			lower_sum += probability[i] * lower[i];
+			if (lower_sum >= beta) {
+				store(beta, LOWER);
+				return beta;
+			}
+		}
+	}
+
+	double known = 0, remaining_lower = lower_sum, remaining_probability = 1; //Star1: the window of each roll follows from the rolls already searched and bounds for the rest
+	for (size_t i = 0; i < FULL_DICE_ROLLS_COUNT; ++i) {
+		remaining_lower -= probability[i] * lower[i];
+		remaining_probability -= probability[i];
+		double roll_alpha = (alpha - known - remaining_probability) / probability[i];
+		double roll_beta = (beta - known - remaining_lower) / probability[i];
+		if (roll_alpha >= 1) {
+			store(alpha, UPPER);
+			return alpha;
+		}
+		double value = this->roll_value(moves.get_moves(full_dice_rolls[i]), depth, std::max(0.0, roll_alpha), std::min(1.0, roll_beta));
+		if (this->stopped) return 0;
+		if (this->star_pruning && value <= roll_alpha) {
+			store(alpha, UPPER);
+			return alpha;
+		}
+		if (this->star_pruning && value >= roll_beta) {
+			store(beta, LOWER);
+			return beta;
+		}
+		known += probability[i] * value;
+	}
+	store(known, EXACT);
+	return known;
+}
+
+template <class F> expectimax_search::result expectimax_search::iterate(std::chrono::milliseconds budget, int max_depth, const iteration_callback &on_iteration, F &&search_depth) {
+	this->deadline = std::chrono::steady_clock::now() + budget;
+	this->deadline_active = false;
+	this->stopped = false;
+	this->nodes = 0;
+	result ret;
+	for (int depth = 1; depth <= max_depth; ++depth) {
+		result current = search_depth(depth);
+		if (this->stopped) break;
+		ret = current;
+		ret.depth = depth;
+		ret.nodes = this->nodes;
+		if (on_iteration) on_iteration(ret);
+		this->deadline_active = true;
+		if (std::chrono::steady_clock::now() >= this->deadline) break;
+	}
+	return ret;
+}
+
+expectimax_search::result expectimax_search::search(const board &b, std::chrono::milliseconds budget, int max_depth, const iteration_callback &on_iteration) {
+	return this->iterate(budget, max_depth, on_iteration, [&](int depth) {
+		result ret;
+		ret.value = this->chance_value(b, depth, 0, 1);
+		return ret;
+	});
+}
+
+expectimax_search::result expectimax_search::search(const board &b, const dice_roll &roll, std::chrono::milliseconds budget, int max_depth, const iteration_callback &on_iteration) {
+	movelist moves = b.generate_moves_lazily();
+	const move_range &candidates = moves.get_moves(roll);
+	return this->iterate(budget, max_depth, on_iteration, [&](int depth) {
+		result ret;
+		const board *best = nullptr;
+		ret.value = this->roll_value(candidates, depth, 0, 1, &best);
+		if (best) ret.best_move = *best;
+		return ret;
+	});
+}
@@ -0,0 +1,57 @@
+#ifndef EXPECTIMAX_H
+#define EXPECTIMAX_H
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <vector>
+#include "board.hpp"
+#include "tablebase.hpp"
+
+/// Depth limited expectimax over the full dice rolls, values are the probability that the side to move wins, in [0, 1]
+/// Depth counts plies, one ply being a dice roll followed by the best move for it.
+/// Chance nodes are searched with Ballard's Star1 and Star2 (probing one move per roll first) pruning, which uses the values being bounded to [0, 1].
+class expectimax_search {
+public:
+	struct result {
+		int depth = 0; ///< Deepest completely searched depth
+		double value = 0;
+		std::optional<board> best_move; ///< Only set when searching for a known dice roll
+		uint64_t nodes = 0; ///< Chance nodes visited so far
+	};
+	using iteration_callback = std::function<void(const result &)>;
+
+	explicit expectimax_search(int transposition_table_bits = 20, bool star_pruning = true);
+
+	/// Iterative deepening until the budget runs out (depth 1 always completes), for a position before rolling the dice
+	result search(const board &b, std::chrono::milliseconds budget, int max_depth = 64, const iteration_callback &on_iteration = {});
+	/// Same, but picks the best move for an already rolled dice roll
+	result search(const board &b, const dice_roll &roll, std::chrono::milliseconds budget, int max_depth = 64, const iteration_callback &on_iteration = {});
+
+	static double evaluate(const board &b); ///< Static guess used at depth 0, based on material only
+	void use_tablebase(const tablebase *tables) {this->tables = tables;} ///< Positions it covers get their exact score at any depth, nullptr to stop
+
+private:
+	enum : uint8_t {EXACT, LOWER, UPPER};
+	struct transposition_entry {
+		hash_type key = 0;
+		float value = 0;
+		int8_t depth = -1; ///< -1 marks an empty slot
+		uint8_t bound = EXACT;
+	};
+	std::vector<transposition_entry> table;
+	bool star_pruning;
+	const tablebase *tables = nullptr;
+	std::chrono::steady_clock::time_point deadline;
+	bool deadline_active = false;
+	bool stopped = false;
+	uint64_t nodes = 0;
+
+	bool out_of_time();
+	double guess(const board &b) const;
+	std::vector<size_t> move_order(const move_range &moves) const;
+	double chance_value(const board &b, int depth, double alpha, double beta);
+	double roll_value(const move_range &moves, int depth, double alpha, double beta, const board **best = nullptr);
+	template <class F> result iterate(std::chrono::milliseconds budget, int max_depth, const iteration_callback &on_iteration, F &&search_depth);
+};
+
+#endif
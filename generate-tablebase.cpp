@@ -0,0 +1,68 @@
+#include <bits/stdc++.h>
+#include "tablebase.hpp"
+using namespace std;
+int main(int argc, char **argv) {
+	vector<uint64_t> materials;
+	string output, input;
+	size_t check_samples = 0;
+	tablebase_generation_options options;
+	options.progress = &cerr;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		try {
+			if (arg == "--output" && i + 1 < argc) output = argv[++i];
+			else if (arg == "--input" && i + 1 < argc) input = argv[++i];
+			else if (arg == "--tolerance" && i + 1 < argc) options.tolerance = stod(argv[++i]);
+			else if (arg == "--max-iterations" && i + 1 < argc) options.max_iterations = stoi(argv[++i]);
+			else if (arg == "--check" && i + 1 < argc) check_samples = stoull(argv[++i]);
+			else if (optional<uint64_t> material = tablebase::parse_material(arg)) materials.push_back(*material);
+			else {
+				cerr << "Not a material set: " << arg << "\n";
+				materials.clear();
+				break;
+			}
+		}
+		catch (const logic_error &) { //stod and stoi's invalid_argument and out_of_range
+			cerr << "Not a number: " << argv[i] << "\n";
+			materials.clear();
+			break;
+		}
+	}
+	if (materials.empty() || output.empty() || !(options.tolerance >= 0) || options.max_iterations < 1) {
+		cerr << "Usage: " << argv[0] << " MATERIAL... --output FILE [--input FILE] [--tolerance T] [--max-iterations N] [--check N]\n";
+		cerr << "MATERIAL is like KRvK or KQvKR (pieces from KQRBN, at most " << tablebase::MAX_PIECES << " with the kings), tables reachable by captures are generated too, --input extends an existing file\n";
+		cerr << "--check compares N random positions of each MATERIAL with one ply of play over the tables and fails past the tolerance\n";
+		return 1;
+	}
+	tablebase tables;
+	if (!input.empty()) {
+		string error;
+		optional<tablebase> loaded = tablebase::load(input, error);
+		if (!loaded) {
+			cerr << error << "\n";
+			return 1;
+		}
+		tables = std::move(*loaded);
+	}
+	for (uint64_t material : materials) {
+		auto start = chrono::steady_clock::now();
+		tables.generate(material, options);
+		cerr << tablebase::material_name(material) << " done in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s\n";
+	}
+	bool checked = true;
+	for (uint64_t material : materials) {
+		if (!check_samples) break;
+		const double residual = *tables.max_residual(material, check_samples);
+		cerr << tablebase::material_name(material) << ": largest difference with one ply over the tables " << residual << "\n";
+		checked &= residual <= options.tolerance + 2.0 / tablebase::VALUE_SCALE; //Floats and rounding to VALUE_SCALE add a little, tables from --input are checked against this tolerance too
+	}
+	if (!tables.save(output)) {
+		cerr << "Can't write " << output << "\n";
+		return 1;
+	}
+	for (uint64_t material : tables.materials()) cout << tablebase::material_name(material) << "\n";
+	if (!checked) {
+		cerr << "Check failed\n";
+		return 1;
+	}
+}
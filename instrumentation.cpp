@@ -0,0 +1,54 @@
+#include "instrumentation.hpp"
+#ifdef DICE_CHESS_INSTRUMENTATION
+#include <iomanip>
+#include <mutex>
+
+namespace instrumentation {
+
+static std::mutex exited_mutex;
+static totals exited; //Guarded by exited_mutex
+
+static const char *const counter_names[COUNTERS_COUNT] = {"layers built", "source boards", "boards pushed", "boards stored", "king captures", "fallbacks", "king capture oracle calls"};
+static const char *const stage_names[STAGES_COUNT] = {"layer expansion", "castling", "dedup", "finalize en passant", "fallback", "king capture oracle"};
+
+thread_totals_holder::~thread_totals_holder() {
+	std::lock_guard lock(exited_mutex);
+	exited.merge(this->data);
+}
+
+totals collect() {
+	std::lock_guard lock(exited_mutex);
+	totals ret = exited;
+	ret.merge(thread_totals());
+	return ret;
+}
+
+void reset() {
+	std::lock_guard lock(exited_mutex);
+	exited = totals();
+	thread_totals() = totals();
+}
+
+void dump(const totals &t, std::ostream &o) {
+	const std::ios_base::fmtflags flags = o.flags();
+	const std::streamsize precision = o.precision();
+	o << "instrumentation counters:\n";
+	for (size_t i = 0; i < COUNTERS_COUNT; ++i) o << "  " << counter_names[i] << " = " << t.counters[i] << "\n";
+	o << "  boards dropped (duplicates, or abandoned for capturing the king) = " << t.counters[BOARDS_PUSHED] - t.counters[BOARDS_STORED] << "\n";
+	o << "instrumentation stages:\n";
+	for (size_t i = 0; i < STAGES_COUNT; ++i) {
+		o << "  " << stage_names[i] << ": " << std::fixed << std::setprecision(3) << t.stage_nanoseconds[i] / 1e6 << "ms over " << t.stage_calls[i] << " calls";
+		if (t.stage_calls[i]) o << " (" << std::setprecision(1) << t.stage_nanoseconds[i] / (double)t.stage_calls[i] << "ns each)";
+		o << "\n";
+	}
+	o.flags(flags);
+	o.precision(precision);
+}
+
+void dump(std::ostream &o) {
+	dump(collect(), o);
+}
+
+}
+
+#endif
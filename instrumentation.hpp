@@ -0,0 +1,95 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/// Counters and timers around the move generation stages, only compiled in with DICE_CHESS_INSTRUMENTATION (the CMake option of the same name).
+/// Every thread counts into its own totals, merged into the process wide ones when the thread exits, so nothing is shared on the hot path.
+/// Disabled, INSTRUMENT_COUNT and INSTRUMENT_STAGE expand to nothing (their arguments aren't evaluated) and dump prints nothing.
+namespace instrumentation {
+
+enum counter : uint8_t {
+	LAYERS_BUILT, ///< Non empty rolls whose layer got generated (not cut short by a source capturing the king)
+	SOURCE_BOARDS, ///< Positions moves were generated from
+	BOARDS_PUSHED, ///< Positions generated, before deduplication
+	BOARDS_STORED, ///< Positions kept in layers after deduplication
+	KING_CAPTURES, ///< Layers where a move captured the king
+	FALLBACKS, ///< Full rolls without any legal move, falling back to their subsets
+	KING_CAPTURE_ORACLE_CALLS,
+	COUNTERS_COUNT
+};
+
+enum stage : uint8_t { //LAYER_EXPANSION doesn't include building the sources, FALLBACK includes its FINALIZE_EN_PASSANT
+	LAYER_EXPANSION,
+	CASTLING,
+	DEDUP,
+	FINALIZE_EN_PASSANT,
+	FALLBACK,
+	KING_CAPTURE_ORACLE,
+	STAGES_COUNT
+};
+
+struct totals {
+	std::array<uint64_t, COUNTERS_COUNT> counters{};
+	std::array<uint64_t, STAGES_COUNT> stage_nanoseconds{}, stage_calls{};
+	void merge(const totals &oth) {
+		for (size_t i = 0; i < COUNTERS_COUNT; ++i) counters[i] += oth.counters[i];
+		for (size_t i = 0; i < STAGES_COUNT; ++i) {
+			stage_nanoseconds[i] += oth.stage_nanoseconds[i];
+			stage_calls[i] += oth.stage_calls[i];
+		}
+	}
+};
+
+#ifdef DICE_CHESS_INSTRUMENTATION
+
+constexpr bool ENABLED = true;
+
+struct thread_totals_holder {
+	totals data;
+	~thread_totals_holder(); ///< Merges data into the process wide totals
+};
+inline thread_local thread_totals_holder current_thread;
+
+inline totals &thread_totals() {return current_thread.data;}
+totals collect(); ///< Threads that exited plus the calling thread
+void reset(); ///< Forgets the totals of threads that exited and of the calling thread
+void dump(std::ostream &o); ///< dump(collect())
+void dump(const totals &t, std::ostream &o);
+
+class scoped_timer {
+	stage which;
+	std::chrono::steady_clock::time_point start;
+public:
+	explicit scoped_timer(stage which) : which(which), start(std::chrono::steady_clock::now()) {}
+	scoped_timer(const scoped_timer &) = delete;
+	scoped_timer &operator=(const scoped_timer &) = delete;
+	~scoped_timer() {
+		totals &t = thread_totals();
+		t.stage_nanoseconds[which] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		t.stage_calls[which]++;
+	}
+};
+
+#define INSTRUMENT_COUNT(name, amount) (instrumentation::thread_totals().counters[instrumentation::name] += (amount))
+#define INSTRUMENT_STAGE(name) instrumentation::scoped_timer instrumentation_timer_##name(instrumentation::name)
+
+#else
+
+constexpr bool ENABLED = false;
+
+inline totals collect() {return {};}
+inline void reset() {}
+inline void dump(std::ostream &) {}
+inline void dump(const totals &, std::ostream &) {}
+
+#define INSTRUMENT_COUNT(name, amount) ((void)0)
+#define INSTRUMENT_STAGE(name) ((void)0)
+
+#endif
+
+}
+
+#endif
@@ -1,16 +1,196 @@
 #include <bits/stdc++.h>
 #include "board.hpp"
+#include "instrumentation.hpp"
+#include "position_file.hpp"
+#include "symmetric_cache.hpp"
 using namespace std;
+
+const size_t BATCH_CHUNK_PER_THREAD = 64; ///< Positions read ahead per worker, output is flushed in input order after every chunk
+const size_t DEFAULT_CACHE_ENTRIES = 1 << 16; ///< Of the batch results cache, ~270 bytes each
+
+enum class batch_format {JSONL, CSV, BINARY, PACKED}; //BINARY writes an annotated position file, PACKED only converts to a position file without analysing
+
+position_annotation analyse(const board &b, symmetric_cache<roll_results> &cache, size_t &distinct_positions) { //Winning rolls, number of moves for every full roll and distinct positions over all of them
+	roll_results results = cache.get(b, [&]{return roll_results::of(b);});
+	position_annotation ret;
+	ret.winning_rolls = results.winning_rolls;
+	ret.moves = results.moves;
+	distinct_positions = results.distinct_positions;
+	return ret;
+}
+
+string format_analysis(size_t line, const board &b, const position_annotation &analysis, size_t distinct_positions, batch_format format) {
+	stringstream ret;
+	if (format == batch_format::JSONL) ret << "{\"line\": " << line << ", \"fen\": \"" << b.fen() << "\", \"winning_rolls\": " << analysis.winning_rolls << ", \"moves\": {";
+	else ret << line << ",\"" << b.fen() << "\"," << analysis.winning_rolls;
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+		if (format == batch_format::JSONL) ret << (i ? ", " : "") << "\"" << full_dice_rolls[i] << "\": " << analysis.moves[i];
+		else ret << "," << analysis.moves[i];
+	}
+	if (format == batch_format::JSONL) ret << "}, \"distinct_positions\": " << distinct_positions << "}";
+	else ret << "," << distinct_positions;
+	return ret.str();
+}
+
+/// next(b, line) fills b with the next input position and line with where it was read (skipped lines make it differ from the record count), it returns false at the end.
+/// Output goes to cout, every record starting with its line, or, for BINARY, to the annotated binary_output.
+void run_batch(const function<bool(board &, size_t &)> &next, batch_format format, unsigned threads, size_t cache_entries, position_file_writer *binary_output) {
+	if (format == batch_format::CSV) {
+		cout << "line,fen,winning_rolls";
+		for (const dice_roll &dice : full_dice_rolls) cout << "," << dice;
+		cout << ",distinct_positions\n";
+	}
+	if (format == batch_format::PACKED) {
+		size_t line;
+		for (board b; next(b, line); )
+			if (!binary_output->write(b)) cerr << "Skipping line " << line << ": " << fen_error_message(check_position(b)) << "\n";
+		return;
+	}
+	symmetric_cache<roll_results> cache(cache_entries); //Symmetric positions (and repeated ones) are generated once
+	vector<board> positions;
+	vector<size_t> lines;
+	vector<position_annotation> analyses;
+	vector<size_t> distinct_positions;
+	board b;
+	size_t line;
+	bool more = true;
+	while (more) {
+		positions.clear();
+		lines.clear();
+		while (positions.size() < threads * BATCH_CHUNK_PER_THREAD && (more = next(b, line))) {
+			positions.push_back(b);
+			lines.push_back(line);
+		}
+		analyses.assign(positions.size(), {});
+		distinct_positions.assign(positions.size(), 0);
+		atomic<size_t> claimed = 0;
+		auto worker = [&]() {
+			for (size_t i; (i = claimed++) < positions.size(); ) analyses[i] = analyse(positions[i], cache, distinct_positions[i]);
+		};
+		vector<thread> workers;
+		for (unsigned i = 1; i < threads; ++i) workers.emplace_back(worker);
+		worker();
+		for (thread &t : workers) t.join();
+		for (size_t i = 0; i < positions.size(); ++i) {
+			if (format != batch_format::BINARY) cout << format_analysis(lines[i], positions[i], analyses[i], distinct_positions[i], format) << "\n";
+			else if (!binary_output->write(positions[i], analyses[i])) cerr << "Skipping line " << lines[i] << ": " << fen_error_message(check_position(positions[i])) << "\n";
+		}
+		cout.flush();
+	}
+}
+
 int main(int argc, char **argv) {
-	assert(argc == 2 || argc == 3);
-	string fen = argv[1];
-	board b = parse_fen(fen);
-	b.dump(std::cerr);
-	b.finalize_en_passant();
-	b.dump(std::cerr);
-	return 0;
+	string fen, batch_input, output;
+	bool batch = false;
+	batch_format format = batch_format::JSONL;
+	unsigned threads = max(1u, thread::hardware_concurrency());
+	size_t cache_entries = DEFAULT_CACHE_ENTRIES;
 	std::optional<dice_roll> roll;
-	if (argc == 3) roll = parse_dice_roll(argv[2]);
+	bool bad_arguments = false;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		try {
+			if (arg == "--batch") {
+				batch = true;
+				if (i + 1 < argc && argv[i + 1][0] != '-') batch_input = argv[++i];
+			}
+			else if (arg == "--threads" && i + 1 < argc) threads = stoul(argv[++i]);
+			else if (arg == "--cache" && i + 1 < argc) cache_entries = stoull(argv[++i]);
+			else if (arg == "--format" && i + 1 < argc) {
+				string name = argv[++i];
+				bad_arguments |= name != "jsonl" && name != "csv" && name != "binary" && name != "packed";
+				format = name == "csv" ? batch_format::CSV : name == "binary" ? batch_format::BINARY : name == "packed" ? batch_format::PACKED : batch_format::JSONL;
+			}
+			else if (arg == "--output" && i + 1 < argc) output = argv[++i];
+			else if (fen.empty()) fen = arg;
+			else {
+				bad_arguments |= roll.has_value();
+				roll = try_parse_dice_roll(arg);
+				bad_arguments |= !roll;
+			}
+		}
+		catch (const logic_error &) { //stoul's invalid_argument and out_of_range
+			bad_arguments = true;
+		}
+	}
+	const bool binary = format == batch_format::BINARY || format == batch_format::PACKED;
+	if (bad_arguments || batch == !fen.empty() || threads == 0 || binary != !output.empty()) {
+		cerr << "Usage: " << argv[0] << " FEN [DICE_ROLL]\n";
+		cerr << "       " << argv[0] << " --batch [FILE] [--format jsonl|csv] [--threads N] [--cache ENTRIES]\n";
+		cerr << "       " << argv[0] << " --batch [FILE] --format binary|packed --output POSITION_FILE [--threads N] [--cache ENTRIES]\n";
+		cerr << "FILE is either FENs one per line (stdin without FILE) or a position file, binary writes an annotated position file, packed just converts\n";
+		cerr << "jsonl and csv records start with their input line (record number from 1 for position files), lines without a legal FEN are skipped with a message on stderr\n";
+		cerr << "Results are cached for up to ENTRIES positions (default " << DEFAULT_CACHE_ENTRIES << ", 0 disables), shared by positions equal up to symmetry\n";
+		return 1;
+	}
+	if (batch) {
+		std::optional<position_file_writer> binary_output;
+		if (binary) {
+			binary_output.emplace(output, format == batch_format::BINARY);
+			if (!binary_output->is_open()) {
+				cerr << "Can't open " << output << "\n";
+				return 1;
+			}
+		}
+		position_file_writer *binary_output_pointer = binary_output ? &*binary_output : nullptr;
+		if (!batch_input.empty() && position_file_reader::is_position_file(batch_input)) {
+			string error;
+			std::optional<position_file_reader> positions = position_file_reader::open(batch_input, error);
+			if (!positions) {
+				cerr << error << "\n";
+				return 1;
+			}
+			size_t at = 0;
+			run_batch([&](board &b, size_t &line) {
+				while (at < positions->size()) {
+					std::optional<board> record = positions->position(at++);
+					line = at;
+					if (record) {
+						b = *record;
+						return true;
+					}
+					cerr << "Skipping record " << at << ": corrupt\n";
+				}
+				return false;
+			}, format, threads, cache_entries, binary_output_pointer);
+		}
+		else {
+			ifstream file;
+			if (!batch_input.empty()) {
+				file.open(batch_input);
+				if (!file) {
+					cerr << "Can't open " << batch_input << "\n";
+					return 1;
+				}
+			}
+			istream &in = batch_input.empty() ? cin : file;
+			string line;
+			size_t line_number = 0;
+			run_batch([&](board &b, size_t &read_line) {
+				while (getline(in, line)) {
+					line_number++;
+					if (!line.empty() && line.back() == '\r') line.pop_back(); //CRLF files
+					if (line.empty()) continue;
+					fen_error error = try_parse_fen(line, b);
+					read_line = line_number;
+					if (error == fen_error::NONE) return true;
+					cerr << "Skipping line " << line_number << ": " << fen_error_message(error) << "\n";
+				}
+				return false;
+			}, format, threads, cache_entries, binary_output_pointer);
+		}
+		instrumentation::dump(std::cerr);
+		if (binary_output && !binary_output->close()) {
+			cerr << "Error writing " << output << "\n";
+			return 1;
+		}
+		return 0;
+	}
+	board b;
+	if (fen_error error = try_parse_fen(fen, b); error != fen_error::NONE) {
+		cerr << "Bad FEN: " << fen_error_message(error) << "\n";
+		return 1;
+	}
 	movelist m = b.generate_moves();
 	b.dump(cout);
 	bool first_empty = true;
@@ -39,4 +219,5 @@ int main(int argc, char **argv) {
 		std::cout << "King capture found from: " << empty.str() << "\n";
 	}
 	std::cout << "Total of " << sum << " different moves, reaching " << all_positions_set.size() << " different positions\n";
+	instrumentation::dump(std::cerr);
 }
@@ -1,68 +1,415 @@
 #include <bits/stdc++.h>
 #include "board.hpp"
+#include "exact_playout.hpp"
+#include "instrumentation.hpp"
+#include "playout_cache.hpp"
+#include "position_file.hpp"
+#include "tablebase.hpp"
+#include "random.hpp"
+#include "statistics.hpp"
 using namespace std;
 
-void output_summary(const std::vector<long double> &data) {
-	assert(!data.empty());
-	long double sum = 0;
-	for (long double x : data) sum += x;
-	long double variance = 0;
-	long double mean = sum / data.size();
-	for (long double x : data) variance += (x - mean) * (x - mean);
-	variance /= data.size() - 1;
-
-	long double std_dev = sqrt(variance);
-	long double error = std_dev / sqrt(data.size());
+const int BATCH_SIZE = 16; ///< Playouts a thread runs between merges into the shared totals
+const long long MIN_SAMPLES_FOR_TARGET_ERROR = 32; ///< Don't trust the error estimate before that
+const int DEFAULT_MAX_PLIES = 1000; ///< Playouts still going after that many plies count as still playing
+const int DEFAULT_CACHE_BITS = 20; ///< King capture slots of the playout cache, 16MiB
+const int DEFAULT_CACHE_PLIES = 2; ///< Positions within that many plies of the start get their movelists cached
+const size_t DEFAULT_CACHE_MEMORY_MB = 512; ///< For those movelists
+
+enum class estimator {PLAIN, STRATIFIED}; //STRATIFIED splits the playouts over the first roll and draws the later rolls directly among the ones not capturing the king
+enum class generator {XOSHIRO256PP, SPLITMIX64, MT19937_64}; //Every thread gets its own stream of the chosen one, see make_thread_rng
+
+struct playout_settings {
+	const tablebase *tables = nullptr;
+	int cache_plies = DEFAULT_CACHE_PLIES;
+	int max_plies = DEFAULT_MAX_PLIES;
+	bool direct_rolls = false; ///< One draw among the rolls not capturing the king, instead of rolling the dice until one doesn't
+	bool dice_at_once = true; ///< Dice rolled with dice_roll::roll_at_once, else one draw per die
+	int importance_plies = 0; ///< Moves of that many first plies are importance sampled, see importance_choice
+};
+
+/// Proportional allocation of the playouts to the starting position's rolls (the strata), the ones capturing the king have a known result and get none.
+/// Over any OMEGA - wins consecutive playouts every roll gets exactly as many as its combinations, interleaved by a stride coprime to that.
+struct stratification {
+	std::vector<long double> weights; ///< By full_dice_rolls index, probability among the rolls not capturing the king
+	std::vector<int> cycle; ///< Stratum of each of the OMEGA - wins positions of a cycle
+	long long stride = 1;
+
+	explicit stratification(uint64_t king_captures) : weights(full_dice_rolls.size(), 0) {
+		for (size_t i = 0; i < full_dice_rolls.size(); ++i)
+			if (!(king_captures >> i & 1)) this->cycle.insert(this->cycle.end(), full_dice_rolls[i].combinations(), i);
+		for (int stratum : this->cycle) this->weights[stratum] += 1.0L / this->cycle.size();
+		const long long size = this->cycle.size();
+		if (size) this->stride = size * 0.618 + 1;
+		while (size && std::gcd(this->stride, size) != 1) this->stride++;
+	}
+	bool empty() const {return this->cycle.empty();}
+	int stratum(long long playout) const {
+		const long long size = this->cycle.size();
+		return this->cycle[playout % size * this->stride % size];
+	}
+};
+
+struct estimate {
+	long double mean = 0;
+	long double variance = 0; ///< Per playout, what a plain average of that many playouts would need for the same error
+	long long count = 0;
+	long double error() const {return count ? sqrtl(variance / count) : 0;} ///< Standard error of the mean
+};
+
+/// Self normalised estimate of an outcome over strata of playouts, sum(p_h * outcome_h) / sum(p_h * weight_h), with the outcome already multiplied by the playout's importance weight.
+/// Without importance sampling every weight is 1 and this is the plain (or stratified) mean, with it dividing by the average weight cancels most of the noise the weights bring.
+/// Strata not sampled yet are left out, which renormalises the probabilities of the others. The variance is the usual first order (delta method) one.
+estimate ratio_estimate(const std::vector<long double> &probabilities, const std::vector<running_covariance> &strata) {
+	estimate ret;
+	long double outcome = 0, weight = 0;
+	for (size_t i = 0; i < strata.size(); ++i) {
+		if (!strata[i].count()) continue;
+		outcome += probabilities[i] * strata[i].x.mean;
+		weight += probabilities[i] * strata[i].y.mean;
+		ret.count += strata[i].count();
+	}
+	if (!ret.count) return ret;
+	ret.mean = outcome / weight;
+	long double variance_of_mean = 0;
+	for (size_t i = 0; i < strata.size(); ++i) {
+		if (!strata[i].count()) continue;
+		const running_covariance &s = strata[i];
+		long double residual_variance = s.x.variance() - 2 * ret.mean * s.covariance() + ret.mean * ret.mean * s.y.variance(); //Of outcome - mean * weight
+		variance_of_mean += probabilities[i] * probabilities[i] * residual_variance / s.count();
+	}
+	ret.variance = variance_of_mean / (weight * weight) * ret.count; //Unnormalised probabilities cancel out
+	return ret;
+}
+
+struct playout_totals {
+	std::array<running_covariance, 3> outcomes; ///< White won, black won and still playing, each against the playout's importance weight
+	std::array<std::vector<running_covariance>, 3> strata; ///< The same by first roll, only for the STRATIFIED estimator
+	playout_cache::counters cache;
+	void add(long double white, long double black, long double still, long double weight, int stratum) {
+		const long double values[3] = {white, black, still};
+		for (int outcome = 0; outcome < 3; ++outcome) outcomes[outcome].add(values[outcome], weight);
+		if (stratum < 0) return;
+		for (int outcome = 0; outcome < 3; ++outcome) {
+			strata[outcome].resize(full_dice_rolls.size());
+			strata[outcome][stratum].add(values[outcome], weight);
+		}
+	}
+	void merge(const playout_totals &oth) {
+		for (int outcome = 0; outcome < 3; ++outcome) {
+			outcomes[outcome].merge(oth.outcomes[outcome]);
+			strata[outcome].resize(max(strata[outcome].size(), oth.strata[outcome].size()));
+			for (size_t i = 0; i < oth.strata[outcome].size(); ++i) strata[outcome][i].merge(oth.strata[outcome][i]);
+		}
+		cache.merge(oth.cache);
+	}
+	long long count() const {return outcomes[0].count();}
+	std::array<estimate, 3> estimates(const stratification *strata_weights) const { //White won, black won, still playing
+		std::array<estimate, 3> ret;
+		for (int outcome = 0; outcome < 3; ++outcome) {
+			if (!strata_weights || strata[outcome].empty()) ret[outcome] = ratio_estimate({1}, {outcomes[outcome]});
+			else ret[outcome] = ratio_estimate(strata_weights->weights, strata[outcome]);
+		}
+		return ret;
+	}
+	long double max_error(const stratification *strata_weights) const {
+		std::array<estimate, 3> e = estimates(strata_weights);
+		return max({e[0].error(), e[1].error(), e[2].error()});
+	}
+};
+
+void output_summary(const estimate &data) {
+	assert(data.count);
+	long double mean = data.mean;
+	long double variance = data.variance;
+
+	long double std_dev = sqrtl(variance);
+	long double error = data.error();
 	long double binary_variable_variance = mean * (1 - mean);
-	
+
 	std::cerr << "mean = " << mean << ", std_dev = " << std_dev << " (error ≈ " << error << "), binary_variable_variance = " << binary_variable_variance << ", including all king capture moves is " << (binary_variable_variance / variance) << " times better than vanilla monte-carlo\n";
 }
-template <class T> const T& random_choice(const std::vector<T> &content, mt19937 &rng) {
+
+void output_summary(const playout_totals &totals, const playout_cache &cache, const stratification *strata_weights) {
+	cerr << "count = " << totals.count() << "\n";
+	auto hit_rate = [](long long hits, long long lookups) {return lookups ? 100.0 * hits / lookups : 0.0;};
+	cerr << "cache: king captures " << hit_rate(totals.cache.hits, totals.cache.lookups) << "% hits, movelists " << hit_rate(totals.cache.moves_hits, totals.cache.moves_lookups) << "% hits (" << cache.moves_memory_used() / (1 << 20) << "MiB)\n";
+	std::array<estimate, 3> estimates = totals.estimates(strata_weights);
+	cerr << "white won: ";
+	output_summary(estimates[0]);
+	cerr << "black won: ";
+	output_summary(estimates[1]);
+	cerr << "still playing: ";
+	output_summary(estimates[2]);
+}
+
+template <class Range, class RNG> const auto &random_choice(const Range &content, RNG &rng) {
 	assert(!content.empty());
-	return content[uniform_int_distribution<size_t>(0, content.size() - 1)(rng)];
+	return content[random_below(rng, content.size())];
+}
+
+int winning_combinations(uint64_t king_captures) { //Out of OMEGA, king_captures as from playout_cache
+	int ret = 0;
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i)
+		if (king_captures >> i & 1) ret += full_dice_rolls[i].combinations();
+	return ret;
+}
+
+template <class RNG> dice_roll draw_roll(uint64_t king_captures, int wins, RNG &rng) { //Among the rolls not capturing the king, by probability, with a single draw
+	int x = random_below(rng, OMEGA - wins);
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+		if (king_captures >> i & 1) continue;
+		x -= full_dice_rolls[i].combinations();
+		if (x < 0) return full_dice_rolls[i];
+	}
+	assert(false);
+	return full_dice_rolls.back();
+}
+
+/// A move drawn half uniformly and half in proportion to the opponent's chances of capturing the king right after it, weight gets multiplied by the likelihood ratio (at most 2) to keep the estimate unbiased
+/// Moves that can end the game on the next roll are where the results differ most, sampling them more often spends the playouts where the variance is.
+template <class Range, class RNG> const board &importance_choice(const Range &moves, playout_cache &cache, playout_cache::counters &stats, RNG &rng, long double &weight) {
+	assert(!moves.empty());
+	const size_t n = moves.size();
+	std::vector<int> wins(n);
+	long long total = 0;
+	for (size_t i = 0; i < n; ++i) total += wins[i] = winning_combinations(cache.king_captures(moves[i], stats));
+	if (!total) return random_choice(moves, rng);
+	long double x = random_unit(rng), proposal = 0;
+	size_t chosen = 0;
+	for (; chosen < n; ++chosen) {
+		proposal = 0.5L / n + 0.5L * wins[chosen] / total;
+		if (x < proposal || chosen == n - 1) break;
+		x -= proposal;
+	}
+	weight *= (1.0L / n) / proposal;
+	return moves[chosen];
+}
+
+template <class RNG> void play_out(const board &starting_position, int first_roll, RNG &rng, const playout_settings &settings, playout_cache &cache, playout_totals &totals) { //first_roll >= 0 forces that full_dice_rolls index for the first ply
+	const tablebase *tables = settings.tables;
+	board b = starting_position;
+	long double white_won = 0, black_won = 0, still_playing = 1, weight = 1; //weight is the product of the importance sampling likelihood ratios, already applied to still_playing
+	for (int ply = 0; ply < settings.max_plies && still_playing > 1e-5 * weight; ++ply) {
+		if (std::optional<tablebase::value> exact = tables ? tables->probe(b) : std::nullopt) { //The rest of the game is known, what's left playing never ends
+			white_won += still_playing * (b.get_to_move() == WHITE ? exact->win : exact->loss);
+			black_won += still_playing * (b.get_to_move() == WHITE ? exact->loss : exact->win);
+			still_playing *= 1 - exact->win - exact->loss;
+			break;
+		}
+		const uint64_t king_captures = cache.king_captures(b, totals.cache); //Bit i for full_dice_rolls[i]
+		int wins_here = winning_combinations(king_captures);
+		long double p_wins_here = wins_here / (long double)OMEGA;
+		if (b.get_to_move() == WHITE) white_won += p_wins_here * still_playing;
+		else black_won += p_wins_here * still_playing;
+		still_playing *= (1 - p_wins_here);
+		if (wins_here == OMEGA) {
+			// cerr << "Found a board where every dice roll wins\n";
+			// b.dump(std::cerr);
+			break;
+		}
+		dice_roll roll;
+		if (ply == 0 && first_roll >= 0) roll = full_dice_rolls[first_roll];
+		else if (settings.direct_rolls) roll = draw_roll(king_captures, wins_here, rng);
+		else {
+			do roll = settings.dice_at_once ? dice_roll::roll_at_once(rng) : dice_roll::roll(rng);
+			while (king_captures >> full_roll_index(roll) & 1);
+		}
+		auto choose = [&](const auto &moves) -> const board & { //still_playing carries the importance weight, everything added later is proportional to it
+			if (ply >= settings.importance_plies) return random_choice(moves, rng);
+			long double ratio = 1;
+			const board &ret = importance_choice(moves, cache, totals.cache, rng, ratio);
+			still_playing *= ratio;
+			weight *= ratio;
+			return ret;
+		};
+		std::shared_ptr<const compact_movelist> cached = ply < settings.cache_plies ? cache.moves(b, totals.cache) : nullptr;
+		if (cached) b = choose(cached->get_moves(roll));
+		else {
+			movelist moves = b.generate_moves_lazily(); //Only the rolled dice get generated
+			b = choose(moves.get_moves(roll));
+		}
+	}
+	totals.add(white_won, black_won, still_playing, weight, first_roll);
 }
+
+template <class RNG> RNG make_batch_rng(uint64_t seed, uint64_t batch_index) { //Deterministic, separate stream for every batch, in O(1) whatever the index
+	const uint64_t x = splitmix64(seed ^ splitmix64(batch_index));
+	if constexpr (is_same_v<RNG, mt19937_64>) {
+		seed_seq sequence{uint32_t(x), uint32_t(x >> 32)};
+		return mt19937_64(sequence);
+	}
+	else if constexpr (is_same_v<RNG, xoshiro256pp>) return xoshiro256pp(x); //Seeded through splitmix64, xoshiro256pp::stream would jump batch_index times
+	else return RNG::stream(seed, batch_index);
+}
+
 int main(int argc, char **argv) {
-	mt19937 rng(10);
-	assert(argc == 2);
-	string fen = argv[1];
-	board starting_position = parse_fen(fen);
-	int count = 0;
-	int next_show = 1;
-	starting_position.dump(cerr);
-	vector <long double> white_win_total, black_win_total, still_playing_total;
-	while (true) {
-		board b = starting_position;
-		count++;
-		long double white_won = 0, black_won = 0, still_playing = 1;
-		for (int _ = 0; _ < 1000 && still_playing > 1e-5; ++_) {
-			auto moves = b.generate_moves();
-			int wins_here = moves.count_winning_on_the_spot();
-			long double p_wins_here = wins_here / (long double)OMEGA;
-			if (b.get_to_move() == WHITE) white_won += p_wins_here * still_playing;
-			else black_won += p_wins_here * still_playing;
-			still_playing *= (1 - p_wins_here);
-			if (wins_here == OMEGA) {
-				// cerr << "Found a board where every dice roll wins\n";
-				// b.dump(std::cerr);
-				break;
+	string fen;
+	unsigned threads = max(1u, thread::hardware_concurrency());
+	long long target_samples = 0; //0 means no limit
+	long double target_error = 0; //0 means no limit
+	uint64_t seed = 10;
+	size_t position_index = 0; //Record to play out from when given a position file instead of a FEN
+	string tablebase_path;
+	int cache_bits = DEFAULT_CACHE_BITS, cache_plies = DEFAULT_CACHE_PLIES;
+	int max_plies = DEFAULT_MAX_PLIES, exact_plies = 0; //exact_plies > 0 evaluates exactly instead of sampling
+	estimator mode = estimator::PLAIN;
+	bool bad_arguments = false;
+	generator rng_kind = generator::XOSHIRO256PP;
+	bool dice_at_once = true;
+	int importance_plies = 0;
+	size_t cache_memory_mb = DEFAULT_CACHE_MEMORY_MB;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		try {
+			if (arg == "--threads" && i + 1 < argc) threads = stoul(argv[++i]);
+			else if (arg == "--samples" && i + 1 < argc) target_samples = stoll(argv[++i]);
+			else if (arg == "--target-error" && i + 1 < argc) target_error = stold(argv[++i]);
+			else if (arg == "--seed" && i + 1 < argc) seed = stoull(argv[++i]);
+			else if (arg == "--index" && i + 1 < argc) position_index = stoull(argv[++i]);
+			else if (arg == "--tablebase" && i + 1 < argc) tablebase_path = argv[++i];
+			else if (arg == "--cache-bits" && i + 1 < argc) cache_bits = stoi(argv[++i]);
+			else if (arg == "--cache-plies" && i + 1 < argc) cache_plies = stoi(argv[++i]);
+			else if (arg == "--cache-memory" && i + 1 < argc) cache_memory_mb = stoull(argv[++i]);
+			else if (arg == "--plies" && i + 1 < argc) max_plies = stoi(argv[++i]);
+			else if (arg == "--exact" && i + 1 < argc) exact_plies = stoi(argv[++i]);
+			else if (arg == "--estimator" && i + 1 < argc) {
+				string name = argv[++i];
+				bad_arguments |= name != "plain" && name != "stratified";
+				mode = name == "stratified" ? estimator::STRATIFIED : estimator::PLAIN;
+			}
+			else if (arg == "--importance-plies" && i + 1 < argc) importance_plies = stoi(argv[++i]);
+			else if (arg == "--rng" && i + 1 < argc) {
+				string name = argv[++i];
+				bad_arguments |= name != "xoshiro256++" && name != "splitmix64" && name != "mt19937_64";
+				rng_kind = name == "splitmix64" ? generator::SPLITMIX64 : name == "mt19937_64" ? generator::MT19937_64 : generator::XOSHIRO256PP;
+			}
+			else if (arg == "--dice" && i + 1 < argc) {
+				string name = argv[++i];
+				bad_arguments |= name != "at-once" && name != "per-die";
+				dice_at_once = name == "at-once";
+			}
+			else {
+				bad_arguments |= !fen.empty();
+				fen = arg;
 			}
-			dice_roll roll;
-			do roll = dice_roll::roll(rng);
-			while (moves.get_moves(roll).empty());
-			b = random_choice(moves.get_moves(roll), rng);
 		}
-		white_win_total.push_back(white_won);
-		black_win_total.push_back(black_won);
-		still_playing_total.push_back(still_playing);
-		if (count >= next_show) {
-			cerr << "count = " << count << "\n";
-			cerr << "white won: ";
-			output_summary(white_win_total);
-			cerr << "black won: ";
-			output_summary(black_win_total);
-			cerr << "still playing: ";
-			output_summary(still_playing_total);
-			next_show = max<int>(count + 1, next_show * 1.05);
+		catch (const logic_error &) { //invalid_argument and out_of_range from the sto* conversions
+			bad_arguments = true;
 		}
 	}
+	if (bad_arguments || fen.empty() || threads == 0 || target_samples < 0 || target_error < 0 || cache_bits < 0 || cache_bits > 40 || cache_plies < 0 || max_plies <= 0 || exact_plies < 0 || importance_plies < 0) {
+		cerr << "Usage: " << argv[0] << " FEN|POSITION_FILE [--index N] [--threads N] [--samples N] [--target-error E] [--seed S] [--tablebase FILE] [--plies N] [--estimator plain|stratified] [--importance-plies K] [--rng xoshiro256++|splitmix64|mt19937_64] [--dice at-once|per-die] [--cache-bits B] [--cache-plies P] [--cache-memory MB]\n";
+		cerr << "       " << argv[0] << " FEN|POSITION_FILE [--index N] [--tablebase FILE] --exact D\n";
+		cerr << "Playouts stop after N plies (default " << DEFAULT_MAX_PLIES << "), --exact computes what playouts with --plies D average to, without sampling\n";
+		cerr << "stratified splits the playouts over the first roll and draws rolls among the ones not capturing the king, the moves of the first K plies get importance sampled (default 0)\n";
+		cerr << "Every batch of " << BATCH_SIZE << " playouts gets its own stream of the generator (default xoshiro256++) from the seed, so results don't depend on --threads, dice come from one draw among " << OMEGA << " (at-once, the default) or one draw per die\n";
+		cerr << "The playout cache keeps the king capturing rolls of 2^B positions (default " << DEFAULT_CACHE_BITS << ", 0 disables) and up to MB megabytes (default " << DEFAULT_CACHE_MEMORY_MB << ") of movelists of positions within P plies from the start (default " << DEFAULT_CACHE_PLIES << ", 0 disables)\n";
+		return 1;
+	}
+	board starting_position;
+	if (position_file_reader::is_position_file(fen)) {
+		string error;
+		std::optional<position_file_reader> positions = position_file_reader::open(fen, error);
+		if (!positions || position_index >= positions->size()) {
+			cerr << (positions ? "No record " + to_string(position_index) + " in " + fen : error) << "\n";
+			return 1;
+		}
+		std::optional<board> record = positions->position(position_index);
+		if (!record) {
+			cerr << "Record " << position_index << " in " << fen << " is corrupt\n";
+			return 1;
+		}
+		starting_position = *record;
+	}
+	else if (fen_error error = try_parse_fen(fen, starting_position); error != fen_error::NONE) {
+		cerr << "Bad FEN: " << fen_error_message(error) << "\n";
+		return 1;
+	}
+	optional<tablebase> tables;
+	if (!tablebase_path.empty()) {
+		string error;
+		tables = tablebase::load(tablebase_path, error);
+		if (!tables) {
+			cerr << error << "\n";
+			return 1;
+		}
+	}
+	starting_position.dump(cerr);
+
+	if (exact_plies) {
+		auto start = chrono::steady_clock::now();
+		exact_playout evaluator(tables ? &*tables : nullptr);
+		exact_playout::outcome result = evaluator.evaluate(starting_position, exact_plies);
+		auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		const bool white = starting_position.get_to_move() == WHITE;
+		cout << "exact after " << exact_plies << " plies: white won = " << (white ? result.won : result.lost) << ", black won = " << (white ? result.lost : result.won) << ", still playing = " << result.still_playing;
+		cout << " (" << evaluator.positions() << " positions, " << elapsed << "ms)" << endl;
+		return 0;
+	}
+	playout_settings settings;
+	settings.tables = tables ? &*tables : nullptr;
+	settings.cache_plies = cache_plies;
+	settings.max_plies = max_plies;
+	settings.direct_rolls = mode == estimator::STRATIFIED;
+	settings.importance_plies = importance_plies;
+	settings.dice_at_once = dice_at_once;
+	optional<stratification> strata;
+	if (mode == estimator::STRATIFIED && !(settings.tables && settings.tables->probe(starting_position))) { //Nothing to split when the tablebase ends every playout right away
+		strata.emplace(full_king_capture_rolls(starting_position));
+		if (strata->empty()) strata.reset();
+	}
+	const stratification *strata_pointer = strata ? &*strata : nullptr;
+
+	playout_cache cache(cache_bits, cache_memory_mb << 20);
+	mutex totals_mutex; //Guards everything below
+	playout_totals totals;
+	map<long long, playout_totals> finished; //Batches by their first playout, waiting for the ones before them
+	long long claimed = 0, merged = 0, next_show = 1;
+	bool done = false;
+	auto claim_batch = [&](long long &first) -> int { //Number of playouts to run next, 0 when done, numbered from first
+		if (done) return 0;
+		int batch = target_samples ? (int)min<long long>(BATCH_SIZE, target_samples - claimed) : BATCH_SIZE;
+		first = claimed;
+		claimed += batch;
+		return batch;
+	};
+	auto worker = [&]<class RNG>(type_identity<RNG>) {
+		long long first;
+		int batch;
+		{
+			lock_guard lock(totals_mutex);
+			batch = claim_batch(first);
+		}
+		while (batch) {
+			RNG rng = make_batch_rng<RNG>(seed, first / BATCH_SIZE); //Playouts only depend on their batch, whichever thread runs it
+			playout_totals local;
+			for (int i = 0; i < batch; ++i) play_out(starting_position, strata ? strata->stratum(first + i) : -1, rng, settings, cache, local);
+			lock_guard lock(totals_mutex);
+			finished.emplace(first, std::move(local));
+			for (auto next = finished.begin(); !done && next != finished.end() && next->first == merged; next = finished.erase(next)) { //Merged in batch order, so the results and where target_error stops only depend on the seed
+				totals.merge(next->second);
+				merged += next->second.count();
+				if (totals.count() >= next_show) {
+					output_summary(totals, cache, strata_pointer);
+					next_show = max<long long>(totals.count() + 1, next_show * 1.05);
+				}
+				if (target_samples && totals.count() >= target_samples) done = true;
+				if (target_error > 0 && totals.count() >= MIN_SAMPLES_FOR_TARGET_ERROR && totals.max_error(strata_pointer) <= target_error) done = true;
+			}
+			batch = claim_batch(first);
+		}
+	};
+	vector<thread> workers;
+	for (unsigned i = 0; i < threads; ++i) workers.emplace_back([&] {
+		switch (rng_kind) {
+			case generator::XOSHIRO256PP: return worker(type_identity<xoshiro256pp>());
+			case generator::SPLITMIX64: return worker(type_identity<splitmix64_generator>());
+			case generator::MT19937_64: return worker(type_identity<mt19937_64>());
+		}
+	});
+	for (thread &t : workers) t.join();
+	cerr << "Final results:\n";
+	output_summary(totals, cache, strata_pointer);
+	instrumentation::dump(cerr); //Workers merged theirs on exit
 }
@@ -0,0 +1,77 @@
+#include "packed_board.hpp"
+#include <cassert>
+#include <cstring>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+#include "splitmix.hpp"
+#include "zobrist.hpp"
+
+packed_board packed_board::pack(const board &b) {
+	packed_board ret{};
+	ret.occupancy = b.occupied();
+	assert(__builtin_popcountll(ret.occupancy) <= MAX_PIECES);
+#ifdef __BMI2__
+	unsigned __int128 nibbles = 0; //Rank by rank, squares is one byte per square so PEXT picks the low nibbles of occupied ones
+	int k = 0;
+	for (int rank = 0; rank < BOARD_HEIGHT; ++rank) {
+		uint64_t row;
+		memcpy(&row, &b.squares[rank][0], sizeof(row));
+		uint64_t row_occupancy = (ret.occupancy >> (rank * BOARD_WIDTH)) & 0xff;
+		if (!row_occupancy) continue;
+		nibbles |= (unsigned __int128)_pext_u64(row, _pdep_u64(row_occupancy, 0x0101010101010101ull) * 0xf) << (4 * k);
+		k += __builtin_popcountll(row_occupancy);
+	}
+	ret.pieces = {uint64_t(nibbles), uint64_t(nibbles >> 64)};
+#else
+	const uint8_t *squares = &b.squares[0][0];
+	int k = 0;
+	for (bitboard remaining = ret.occupancy; remaining; remaining &= remaining - 1, ++k)
+		ret.pieces[k / 16] |= uint64_t(squares[__builtin_ctzll(remaining)]) << (4 * (k % 16));
+#endif
+	ret.castling_mask = b.castling_mask;
+	ret.to_move = b.to_move;
+	ret.en_passant_mask = b.en_passant_mask;
+	return ret;
+}
+
+board packed_board::unpack() const {
+	board ret;
+	ret.squares = {};
+	std::array<bitboard, 16> by_piece = {}; //Indexed by the piece code, split into piece and player bitboards at the end
+	hash_type key = zobrist.castling[this->castling_mask] ^ zobrist.en_passant[this->en_passant_mask] ^ (this->to_move == BLACK ? zobrist.black_to_move : 0);
+	uint8_t *squares = &ret.squares[0][0];
+	int k = 0;
+	for (bitboard remaining = this->occupancy; remaining; remaining &= remaining - 1, ++k) {
+		int square = __builtin_ctzll(remaining);
+		uint8_t piece = (this->pieces[k / 16] >> (4 * (k % 16))) & 15;
+		squares[square] = piece;
+		by_piece[piece] |= bitboard(1) << square;
+		key ^= zobrist.piece_square[piece][square];
+	}
+	ret.player_bitboards = {};
+	for (uint8_t piece : PIECE_TYPES) {
+		ret.piece_bitboards[piece / 2 - 1] = by_piece[make_piece(piece, WHITE)] | by_piece[make_piece(piece, BLACK)];
+		ret.player_bitboards[WHITE] |= by_piece[make_piece(piece, WHITE)];
+		ret.player_bitboards[BLACK] |= by_piece[make_piece(piece, BLACK)];
+	}
+	ret.castling_mask = this->castling_mask;
+	ret.to_move = this->to_move;
+	ret.en_passant_mask = this->en_passant_mask;
+	ret.key = key;
+	return ret;
+}
+
+bool packed_board::valid() const {
+	const int count = __builtin_popcountll(this->occupancy);
+	if (count > MAX_PIECES || this->castling_mask >= zobrist.castling.size() || this->to_move > BLACK) return false;
+	for (int k = 0; k < MAX_PIECES; ++k) {
+		const uint8_t piece = (this->pieces[k / 16] >> (4 * (k % 16))) & 15;
+		if (k < count ? piece < PAWN || piece > make_piece(KING, BLACK) : piece != EMPTY) return false;
+	}
+	return true;
+}
+
+hash_type packed_board::hash() const {
+	return splitmix64(this->occupancy ^ splitmix64(this->pieces[0] ^ splitmix64(this->pieces[1] ^ (this->castling_mask | this->to_move << 4 | this->en_passant_mask << 8))));
+}
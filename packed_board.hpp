@@ -0,0 +1,23 @@
+#ifndef PACKED_BOARD_H
+#define PACKED_BOARD_H
+#include "board.hpp"
+
+/// 32 byte encoding of a position for caches and files: the occupancy and a 4 bit piece code per occupied square.
+/// Holds up to 32 pieces, which covers everything reachable from a legal starting position (promotions only replace pawns).
+struct packed_board {
+	bitboard occupancy;
+	std::array<uint64_t, 2> pieces; /// <Nibble k is the piece (as in board::squares) on the k-th lowest occupied square
+	uint8_t castling_mask;
+	uint8_t to_move;
+	uint8_t en_passant_mask;
+
+	static constexpr int MAX_PIECES = 32;
+	static packed_board pack(const board &b); ///< b must have at most MAX_PIECES pieces, see check_position()
+	board unpack() const; ///< Only for valid() encodings, anything else indexes out of bounds
+	bool valid() const; ///< What pack() can produce: at most MAX_PIECES pieces, real piece codes, flags in range, unused nibbles zero
+	hash_type hash() const;
+	auto operator<=>(const packed_board &oth) const = default;
+};
+static_assert(sizeof(packed_board) == 32);
+
+#endif
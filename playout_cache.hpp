@@ -0,0 +1,124 @@
+#ifndef PLAYOUT_CACHE_H
+#define PLAYOUT_CACHE_H
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "board.hpp"
+
+/// Position of a full roll in full_dice_rolls, -1 for partial rolls
+inline int full_roll_index(const dice_roll &dice) {
+	static const std::array<int8_t, DICE_ROLL_LENGTH> index = []{ //Built on first use, full_dice_rolls needn't be initialized before this header's users
+		std::array<int8_t, DICE_ROLL_LENGTH> ret;
+		ret.fill(-1);
+		for (size_t i = 0; i < full_dice_rolls.size(); ++i) ret[full_dice_rolls[i].encode()] = i;
+		return ret;
+	}();
+	return index[dice.encode()];
+}
+
+/// Bit i set when full_dice_rolls[i] captures the king, the same rolls generate_moves leaves empty
+inline uint64_t full_king_capture_rolls(const board &b) {
+	const std::bitset<DICE_ROLL_LENGTH> rolls = b.king_capture_rolls();
+	uint64_t ret = 0;
+	for (size_t i = 0; i < full_dice_rolls.size(); ++i) ret |= uint64_t(rolls[full_dice_rolls[i].encode()]) << i;
+	return ret;
+}
+
+/// Successors of every full roll of a position in one block, in get_moves order, without the arena and the partial rolls a movelist keeps
+class compact_movelist {
+	board origin;
+	std::vector<board> boards;
+	std::array<uint32_t, FULL_DICE_ROLLS_COUNT + 1> begin; ///< By full_roll_index()
+public:
+	explicit compact_movelist(const board &b) : origin(b) {
+		movelist moves = b.generate_moves_lazily(); //Generated roll by roll, so the order is the one playouts without the cache see
+		for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+			this->begin[i] = this->boards.size();
+			const move_range &roll_moves = moves.get_moves(full_dice_rolls[i]);
+			this->boards.insert(this->boards.end(), roll_moves.begin(), roll_moves.end());
+		}
+		this->begin[full_dice_rolls.size()] = this->boards.size();
+		this->boards.shrink_to_fit();
+	}
+	const board &position() const {return this->origin;}
+	std::span<const board> get_moves(const dice_roll &dice) const { ///< Empty when dice captures the king, dice must be a full roll
+		const int i = full_roll_index(dice);
+		assert(i >= 0);
+		return std::span<const board>(this->boards.data() + this->begin[i], this->boards.data() + this->begin[i + 1]);
+	}
+	size_t memory() const {return sizeof(*this) + this->boards.capacity() * sizeof(board);}
+};
+
+/// Results shared by all the playout threads: the full rolls capturing the king for any position, in a lock free table, and the compact movelists of the positions playouts start with, up to a memory budget.
+/// The table keeps the latest position per slot, a position is recognised by its hash alone (as in the expectimax transposition table).
+/// Movelists are never evicted, the first positions stored are the ones closest to the start of the playouts, which all of them go through.
+class playout_cache {
+	static constexpr size_t SHARDS = 64;
+	struct slot {
+		std::atomic<uint64_t> check{0}; ///< hash ^ captures, so a slot torn between two writers fails the check instead of mixing them
+		std::atomic<uint64_t> captures{0};
+	};
+	struct shard {
+		std::mutex lock;
+		std::unordered_map<hash_type, std::shared_ptr<const compact_movelist>> moves;
+	};
+	std::vector<slot> slots;
+	std::array<shard, SHARDS> shards;
+	std::atomic<size_t> moves_memory{0};
+	size_t moves_budget;
+public:
+	struct counters {
+		long long lookups = 0, hits = 0, moves_lookups = 0, moves_hits = 0;
+		void merge(const counters &oth) {
+			lookups += oth.lookups;
+			hits += oth.hits;
+			moves_lookups += oth.moves_lookups;
+			moves_hits += oth.moves_hits;
+		}
+	};
+
+	/// 2^bits king capture slots (16 bytes each, 0 disables them) and up to moves_budget bytes of movelists
+	playout_cache(int bits, size_t moves_budget) : slots(bits ? size_t(1) << bits : 0), moves_budget(moves_budget) {}
+
+	uint64_t king_captures(const board &b, counters &stats) { ///< As full_king_capture_rolls(b)
+		if (this->slots.empty()) return full_king_capture_rolls(b);
+		stats.lookups++;
+		slot &s = this->slots[b.hash() & (this->slots.size() - 1)];
+		const uint64_t captures = s.captures.load(std::memory_order_relaxed);
+		if ((s.check.load(std::memory_order_relaxed) ^ captures) == b.hash()) {
+			stats.hits++;
+			return captures;
+		}
+		const uint64_t ret = full_king_capture_rolls(b);
+		s.captures.store(ret, std::memory_order_relaxed);
+		s.check.store(b.hash() ^ ret, std::memory_order_relaxed);
+		return ret;
+	}
+
+	/// Cached movelist of b, built and stored when missing, nullptr when it isn't there and the budget is used up
+	std::shared_ptr<const compact_movelist> moves(const board &b, counters &stats) {
+		stats.moves_lookups++;
+		shard &s = this->shards[b.hash() % SHARDS];
+		{
+			std::lock_guard lock(s.lock);
+			auto found = s.moves.find(b.hash());
+			if (found != s.moves.end() && found->second->position() == b) {
+				stats.moves_hits++;
+				return found->second;
+			}
+		}
+		if (this->moves_memory.load(std::memory_order_relaxed) >= this->moves_budget) return nullptr;
+		auto ret = std::make_shared<const compact_movelist>(b); //Built outside the lock, two threads may both build it, the second one is dropped
+		std::lock_guard lock(s.lock);
+		if (s.moves.emplace(b.hash(), ret).second) this->moves_memory += ret->memory();
+		return ret;
+	}
+
+	size_t moves_memory_used() const {return this->moves_memory.load(std::memory_order_relaxed);}
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "position_file.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+position_file_writer::position_file_writer(const std::string &path, bool annotated) : file(fopen(path.c_str(), "wb")) {
+	this->header.record_size = sizeof(packed_board) + (annotated ? sizeof(position_annotation) : 0);
+	this->header.flags = annotated ? uint32_t(position_file_header::ANNOTATED) : 0;
+	if (this->file) this->failed = fwrite(&this->header, sizeof(this->header), 1, this->file) != 1; //Count rewritten on close
+}
+
+position_file_writer::~position_file_writer() {
+	this->close();
+}
+
+bool position_file_writer::close() {
+	if (!this->file) return !this->failed;
+	if (fseek(this->file, 0, SEEK_SET) != 0 || fwrite(&this->header, sizeof(this->header), 1, this->file) != 1) this->failed = true;
+	if (fclose(this->file) != 0) this->failed = true; //Buffered writes can fail only here
+	this->file = nullptr;
+	return !this->failed;
+}
+
+bool position_file_writer::write(const board &b, const position_annotation &annotation) {
+	assert(this->file);
+	if (check_position(b) != fen_error::NONE) return false;
+	packed_board packed = packed_board::pack(b);
+	char record[sizeof(packed_board) + sizeof(position_annotation)] = {}; //Copied field by field so padding is always zero
+	memcpy(record, &packed.occupancy, sizeof(packed.occupancy));
+	memcpy(record + offsetof(packed_board, pieces), &packed.pieces, sizeof(packed.pieces));
+	record[offsetof(packed_board, castling_mask)] = packed.castling_mask;
+	record[offsetof(packed_board, to_move)] = packed.to_move;
+	record[offsetof(packed_board, en_passant_mask)] = packed.en_passant_mask;
+	if (this->header.flags & position_file_header::ANNOTATED) memcpy(record + sizeof(packed_board), &annotation, sizeof(annotation));
+	if (fwrite(record, this->header.record_size, 1, this->file) != 1) this->failed = true;
+	else this->header.count++;
+	return true;
+}
+
+bool position_file_reader::is_position_file(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) return false;
+	std::array<char, 8> magic = {};
+	bool ret = fread(magic.data(), magic.size(), 1, file) == 1 && magic == position_file_header::MAGIC;
+	fclose(file);
+	return ret;
+}
+
+std::optional<position_file_reader> position_file_reader::open(const std::string &path, std::string &error) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error = "can't open " + path + ": " + strerror(errno);
+		return std::nullopt;
+	}
+	struct stat status;
+	if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(position_file_header)) {
+		close(fd);
+		error = path + " is too short for a position file";
+		return std::nullopt;
+	}
+	void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //The mapping stays valid
+	if (mapped == MAP_FAILED) {
+		error = "can't map " + path + ": " + strerror(errno);
+		return std::nullopt;
+	}
+	madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+	position_file_reader ret;
+	ret.data = static_cast<const char *>(mapped);
+	ret.mapped_size = status.st_size;
+	ret.header = reinterpret_cast<const position_file_header *>(ret.data);
+	const position_file_header &header = *ret.header;
+	if (header.magic != position_file_header::MAGIC) error = path + " is not a position file";
+	else if (header.version != position_file_header::VERSION) error = path + " has unsupported version " + std::to_string(header.version);
+	else if (header.record_size != sizeof(packed_board) + (header.flags & position_file_header::ANNOTATED ? sizeof(position_annotation) : 0)) error = path + " has a bad record size";
+	else if ((ret.mapped_size - sizeof(position_file_header)) / header.record_size < header.count) error = path + " is truncated";
+	else return ret;
+	return std::nullopt;
+}
+
+std::optional<board> position_file_reader::position(size_t i) const {
+	const packed_board &record = this->packed(i);
+	if (!record.valid()) return std::nullopt; //unpack() would index out of bounds
+	board ret = record.unpack();
+	if (check_position(ret) != fen_error::NONE) return std::nullopt;
+	return ret;
+}
+
+position_file_reader::position_file_reader(position_file_reader &&oth) : data(oth.data), mapped_size(oth.mapped_size), header(oth.header) {
+	oth.data = nullptr;
+	oth.mapped_size = 0;
+	oth.header = nullptr;
+}
+
+position_file_reader &position_file_reader::operator=(position_file_reader &&oth) {
+	std::swap(this->data, oth.data);
+	std::swap(this->mapped_size, oth.mapped_size);
+	std::swap(this->header, oth.header);
+	return *this;
+}
+
+position_file_reader::~position_file_reader() {
+	if (this->data) munmap(const_cast<char *>(this->data), this->mapped_size);
+}
@@ -0,0 +1,75 @@
+#ifndef POSITION_FILE_H
+#define POSITION_FILE_H
+#include <cstdio>
+#include <optional>
+#include <string>
+#include "packed_board.hpp"
+
+/// Binary file of fixed size position records: a header, then count records of record_size bytes each, little endian as in memory.
+/// A record is a packed_board, followed by a position_annotation when the file is ANNOTATED.
+/// The reader maps the file and hands out references into it, opening only checks the header so nothing is read before a record is actually used, position() checks that record.
+struct position_file_header {
+	static constexpr std::array<char, 8> MAGIC = {'D', 'C', 'P', 'O', 'S', 'I', 'T', '\n'};
+	static constexpr uint32_t VERSION = 1;
+	enum : uint32_t {ANNOTATED = 1};
+
+	std::array<char, 8> magic = MAGIC;
+	uint32_t version = VERSION;
+	uint32_t record_size = 0;
+	uint32_t flags = 0;
+	uint32_t reserved = 0;
+	uint64_t count = 0;
+};
+static_assert(sizeof(position_file_header) == 32);
+
+/// Optional per position data, the results of analysing it
+struct position_annotation {
+	float evaluation = 0; ///< Probability of the side to move winning, by whatever produced the file
+	uint16_t winning_rolls = 0; ///< Out of OMEGA
+	std::array<uint16_t, FULL_DICE_ROLLS_COUNT> moves = {}; ///< Moves for every full roll, in full_dice_rolls order, 0 where the king gets captured
+	uint16_t reserved = 0;
+};
+static_assert(sizeof(position_annotation) == 120); //Changing it changes the format, bump VERSION
+
+class position_file_writer {
+	FILE *file = nullptr;
+	position_file_header header;
+	bool failed = false; ///< Some write went wrong, the file is incomplete
+public:
+	position_file_writer(const std::string &path, bool annotated); ///< Truncates path, check is_open()
+	position_file_writer(const position_file_writer &) = delete;
+	position_file_writer &operator=(const position_file_writer &) = delete;
+	~position_file_writer(); ///< close() if not done yet, ignoring failures
+	bool is_open() const {return this->file != nullptr;}
+	bool write(const board &b, const position_annotation &annotation = {}); ///< false, writing nothing, for boards check_position() rejects (packed_board can't hold all of them), the annotation is dropped unless the file is annotated, I/O failures are reported by close()
+	bool close(); ///< Writes the final count into the header and closes the file, false if that or any write() failed
+};
+
+class position_file_reader {
+	const char *data = nullptr;
+	size_t mapped_size = 0;
+	const position_file_header *header = nullptr;
+	position_file_reader() = default;
+public:
+	/// Maps path, nullopt with error set when it can't be opened, isn't a position file of a known version or is shorter than its header says
+	static std::optional<position_file_reader> open(const std::string &path, std::string &error);
+	static bool is_position_file(const std::string &path); ///< Cheap check of the magic, to tell these from FEN text
+	position_file_reader(position_file_reader &&oth);
+	position_file_reader &operator=(position_file_reader &&oth);
+	~position_file_reader();
+
+	size_t size() const {return this->header->count;}
+	bool annotated() const {return this->header->flags & position_file_header::ANNOTATED;}
+	const packed_board &packed(size_t i) const {return *reinterpret_cast<const packed_board *>(this->record(i));}
+	std::optional<board> position(size_t i) const; ///< nullopt for corrupt records: not packed_board::valid() or rejected by check_position(), as a FEN of the board would be
+	const position_annotation *annotation(size_t i) const { ///< nullptr for files without annotations
+		return this->annotated() ? reinterpret_cast<const position_annotation *>(this->record(i) + sizeof(packed_board)) : nullptr;
+	}
+private:
+	const char *record(size_t i) const {
+		assert(i < this->size());
+		return this->data + sizeof(position_file_header) + i * this->header->record_size;
+	}
+};
+
+#endif
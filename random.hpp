@@ -0,0 +1,87 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include "splitmix.hpp"
+
+/// Random generators for playouts and dice: any class with 64 bit result_type, min() 0 and max() UINT64_MAX (std::mt19937_64 too) works with the helpers below.
+
+/// Weyl sequence through splitmix64, a single word of state
+class splitmix64_generator {
+	uint64_t state;
+public:
+	using result_type = uint64_t;
+	explicit splitmix64_generator(uint64_t seed) : state(seed) {}
+	static constexpr result_type min() {return 0;}
+	static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+	result_type operator()() {
+		const uint64_t ret = splitmix64(this->state);
+		this->state += 0x9e3779b97f4a7c15;
+		return ret;
+	}
+	static splitmix64_generator stream(uint64_t seed, uint64_t index) {return splitmix64_generator(splitmix64(seed ^ splitmix64(index)));} ///< Streams for different indices start far apart
+};
+
+/// xoshiro256++ (Blackman and Vigna), seeded through splitmix64 as its authors recommend
+class xoshiro256pp {
+	std::array<uint64_t, 4> s;
+	static constexpr uint64_t rotl(uint64_t x, int k) {return (x << k) | (x >> (64 - k));}
+public:
+	using result_type = uint64_t;
+	explicit xoshiro256pp(const std::array<uint64_t, 4> &state) : s(state) {assert((state != std::array<uint64_t, 4>{}));}
+	explicit xoshiro256pp(uint64_t seed) {
+		splitmix64_generator seeder(seed);
+		for (uint64_t &x : this->s) x = seeder();
+	}
+	static constexpr result_type min() {return 0;}
+	static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+	result_type operator()() {
+		const uint64_t ret = rotl(this->s[0] + this->s[3], 23) + this->s[0];
+		const uint64_t t = this->s[1] << 17;
+		this->s[2] ^= this->s[0];
+		this->s[3] ^= this->s[1];
+		this->s[1] ^= this->s[2];
+		this->s[0] ^= this->s[3];
+		this->s[2] ^= t;
+		this->s[3] = rotl(this->s[3], 45);
+		return ret;
+	}
+	void jump() { ///< Advances by 2^128 outputs
+		static constexpr uint64_t JUMP[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+		std::array<uint64_t, 4> ret = {};
+		for (uint64_t word : JUMP)
+			for (int bit = 0; bit < 64; ++bit) {
+				if (word >> bit & 1)
+					for (int i = 0; i < 4; ++i) ret[i] ^= this->s[i];
+				(*this)();
+			}
+		this->s = ret;
+	}
+	static xoshiro256pp stream(uint64_t seed, uint64_t index) { ///< index jumps from the seed's sequence, so streams never overlap
+		xoshiro256pp ret(seed);
+		for (uint64_t i = 0; i < index; ++i) ret.jump();
+		return ret;
+	}
+};
+
+/// Uniform in [0, n), unbiased, one multiplication and almost never a second draw (Lemire, "Fast Random Integer Generation in an Interval")
+template <class RNG> uint64_t random_below(RNG &rng, uint64_t n) {
+	static_assert(RNG::min() == 0 && RNG::max() == std::numeric_limits<uint64_t>::max(), "needs 64 random bits per call");
+	assert(n);
+	unsigned __int128 product = (unsigned __int128)rng() * n;
+	if ((uint64_t)product < n) {
+		const uint64_t threshold = -n % n; //2^64 mod n, the low words below it would make some results more likely
+		while ((uint64_t)product < threshold) product = (unsigned __int128)rng() * n;
+	}
+	return product >> 64;
+}
+
+/// Uniform in [0, 1) with 53 random bits
+template <class RNG> double random_unit(RNG &rng) {
+	static_assert(RNG::min() == 0 && RNG::max() == std::numeric_limits<uint64_t>::max(), "needs 64 random bits per call");
+	return (rng() >> 11) * 0x1.0p-53;
+}
+
+#endif
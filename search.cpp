@@ -0,0 +1,59 @@
+#include <bits/stdc++.h>
+#include "board.hpp"
+#include "expectimax.hpp"
+using namespace std;
+int main(int argc, char **argv) {
+	string fen;
+	optional<dice_roll> roll;
+	int time_ms = 1000, max_depth = 64;
+	string tablebase_path;
+	bool bad_arguments = false;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		try {
+			if (arg == "--time" && i + 1 < argc) time_ms = stoi(argv[++i]);
+			else if (arg == "--depth" && i + 1 < argc) max_depth = stoi(argv[++i]);
+			else if (arg == "--tablebase" && i + 1 < argc) tablebase_path = argv[++i];
+			else if (fen.empty()) fen = arg;
+			else {
+				bad_arguments |= roll.has_value();
+				roll = try_parse_dice_roll(arg);
+				bad_arguments |= !roll;
+			}
+		}
+		catch (const logic_error &) { //stoi's invalid_argument and out_of_range
+			bad_arguments = true;
+		}
+	}
+	if (bad_arguments || fen.empty() || time_ms < 0 || max_depth < 1) {
+		cerr << "Usage: " << argv[0] << " FEN [DICE_ROLL] [--time MILLISECONDS] [--depth N] [--tablebase FILE]\n";
+		cerr << "DICE_ROLL is " << DICE_COUNT << " letters from PNBRQK\n";
+		return 1;
+	}
+	board b;
+	if (fen_error error = try_parse_fen(fen, b); error != fen_error::NONE) {
+		cerr << "Bad FEN: " << fen_error_message(error) << "\n";
+		return 1;
+	}
+	b.dump(cerr);
+	expectimax_search engine;
+	optional<tablebase> tables;
+	if (!tablebase_path.empty()) {
+		string error;
+		tables = tablebase::load(tablebase_path, error);
+		if (!tables) {
+			cerr << error << "\n";
+			return 1;
+		}
+		engine.use_tablebase(&*tables);
+	}
+	auto start = chrono::steady_clock::now();
+	auto report = [&](const expectimax_search::result &r) {
+		auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		cout << "depth " << r.depth << ": value = " << r.value;
+		if (r.best_move) cout << ", best move = " << r.best_move->fen();
+		cout << ", nodes = " << r.nodes << ", time = " << elapsed << "ms" << endl;
+	};
+	expectimax_search::result r = roll ? engine.search(b, *roll, chrono::milliseconds(time_ms), max_depth, report) : engine.search(b, chrono::milliseconds(time_ms), max_depth, report);
+	if (r.best_move) r.best_move->dump(cerr);
+}
@@ -1,7 +1,7 @@
 #ifndef SPLITMIX_H
 #define SPLITMIX_H
 #include <cstdint>
-static uint64_t splitmix64(uint64_t x) {
+static constexpr uint64_t splitmix64(uint64_t x) {
   x += 0x9e3779b97f4a7c15;
   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
   x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
@@ -0,0 +1,64 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+#include <cmath>
+
+/// Streaming mean and variance (Welford), mergeable with Chan's parallel formula, O(1) memory and O(1) reporting however many samples were added
+struct running_statistics {
+	long long count = 0;
+	long double mean = 0;
+	long double m2 = 0; /// <Sum of squared differences from the current mean
+
+	void add(long double x) {
+		count++;
+		long double delta = x - mean;
+		mean += delta / count;
+		m2 += delta * (x - mean);
+	}
+
+	void merge(const running_statistics &oth) {
+		if (!oth.count) return;
+		if (!count) {
+			*this = oth;
+			return;
+		}
+		long long total = count + oth.count;
+		long double delta = oth.mean - mean;
+		mean += delta * oth.count / total;
+		m2 += oth.m2 + delta * delta * count * oth.count / total;
+		count = total;
+	}
+
+	long double variance() const {return count > 1 ? m2 / (count - 1) : 0;} ///< Sample variance
+	long double std_dev() const {return std::sqrt(variance());}
+	long double error() const {return count ? std::sqrt(variance() / count) : 0;} ///< Standard error of the mean
+};
+
+/// Streaming statistics of pairs of samples, each variable as running_statistics plus their covariance, mergeable the same way
+struct running_covariance {
+	running_statistics x, y;
+	long double c = 0; ///< Sum of products of the differences from the current means
+
+	void add(long double x_value, long double y_value) {
+		long double x_delta = x_value - x.mean; //From the mean before adding, y's from the mean after
+		x.add(x_value);
+		y.add(y_value);
+		c += x_delta * (y_value - y.mean);
+	}
+
+	void merge(const running_covariance &oth) {
+		if (!oth.x.count) return;
+		if (!x.count) {
+			*this = oth;
+			return;
+		}
+		long long total = x.count + oth.x.count;
+		c += oth.c + (oth.x.mean - x.mean) * (oth.y.mean - y.mean) * x.count * oth.x.count / total;
+		x.merge(oth.x);
+		y.merge(oth.y);
+	}
+
+	long long count() const {return x.count;}
+	long double covariance() const {return x.count > 1 ? c / (x.count - 1) : 0;} ///< Sample covariance
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SYMMETRIC_CACHE_H
+#define SYMMETRIC_CACHE_H
+#include <array>
+#include <bit>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "board.hpp"
+
+/// Per roll results of generate_moves, the same for all the positions sharing a board::canonical() form
+struct roll_results {
+	uint16_t winning_rolls = 0; ///< count_winning_on_the_spot(), out of OMEGA
+	std::array<uint16_t, FULL_DICE_ROLLS_COUNT> moves = {}; ///< Moves for every full roll, in full_dice_rolls order, 0 where the king gets captured
+	uint32_t distinct_positions = 0; ///< Over all the full rolls together
+
+	static roll_results of(const board &b) {
+		movelist m = b.generate_moves();
+		roll_results ret;
+		ret.winning_rolls = m.count_winning_on_the_spot();
+		std::set<board> distinct;
+		for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+			const move_range &moves = m.get_moves(full_dice_rolls[i]);
+			distinct.insert(moves.begin(), moves.end());
+			ret.moves[i] = moves.size();
+		}
+		ret.distinct_positions = distinct.size();
+		return ret;
+	}
+};
+
+/// Bounded cache of results that only depend on a position up to symmetry, keyed by board::canonical() so that all the positions of a class share one entry.
+/// Direct mapped by the canonical hash, a new entry replaces whatever was in its slot. Safe to share between threads, slots are locked in shards and results are computed outside the locks.
+template <class T> class symmetric_cache {
+	static constexpr size_t SHARDS = 64;
+	struct slot {
+		board key;
+		T value;
+		bool used = false;
+	};
+	std::vector<slot> slots;
+	std::array<std::mutex, SHARDS> locks;
+public:
+	explicit symmetric_cache(size_t capacity) : slots(capacity ? std::bit_ceil(capacity) : 0) {} ///< Rounded up to a power of two, 0 disables caching
+
+	/// The cached result for b or a symmetric position, else compute() (which must give the same for all of them) stored and returned
+	template <class F> T get(const board &b, F &&compute) {
+		if (this->slots.empty()) return compute();
+		const board key = b.canonical();
+		const size_t i = key.hash() & (this->slots.size() - 1);
+		{
+			std::lock_guard lock(this->locks[i % SHARDS]);
+			if (this->slots[i].used && this->slots[i].key == key) return this->slots[i].value;
+		}
+		T ret = compute();
+		std::lock_guard lock(this->locks[i % SHARDS]);
+		this->slots[i] = {key, ret, true};
+		return ret;
+	}
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include "tablebase.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include "packed_board.hpp"
+#include "splitmix.hpp"
+
+static const uint8_t TABLEBASE_PIECES[] = {KING, QUEEN, ROOK, BISHOP, KNIGHT}; //Index order within a colour, strongest first
+static const char TABLEBASE_PIECE_NAMES[] = "KQRBN";
+static const int PLAYER_MATERIAL_BITS = 4 * PIECES_TYPES_COUNT;
+static const uint64_t PLAYER_MATERIAL_MASK = (uint64_t(1) << PLAYER_MATERIAL_BITS) - 1;
+static const std::array<char, 8> TABLEBASE_MAGIC = {'D', 'C', 'T', 'B', 'A', 'S', 'E', '\n'};
+static const uint32_t TABLEBASE_VERSION = 2;
+
+static int material_shift(uint8_t raw_piece, uint8_t player) {return 4 * (raw_piece / 2 - 1) + PLAYER_MATERIAL_BITS * player;}
+static int material_count(uint64_t material, uint8_t raw_piece, uint8_t player) {return material >> material_shift(raw_piece, player) & 0xf;}
+static int pieces_count(uint64_t material) {
+	int ret = 0;
+	for (uint8_t player : {WHITE, BLACK})
+		for (uint8_t piece : PIECE_TYPES) ret += material_count(material, piece, player);
+	return ret;
+}
+static size_t table_size(uint64_t material) {return size_t(2) << (6 * pieces_count(material));}
+static int code_bits(size_t dictionary_size) {return dictionary_size > 1 ? 64 - __builtin_clzll(dictionary_size - 1) : 0;}
+static size_t code_words(size_t stored_count, int bits) {return (stored_count * bits + 63) / 64 + 1;}
+
+void tablebase::table::build_rank() {
+	this->rank.resize(this->stored.size());
+	uint32_t count = 0;
+	for (size_t w = 0; w < this->stored.size(); ++w) {
+		this->rank[w] = count;
+		count += __builtin_popcountll(this->stored[w]);
+	}
+}
+
+void tablebase::table::pack(const std::vector<std::array<uint16_t, 2>> &values) {
+	this->dictionary = values;
+	std::sort(this->dictionary.begin(), this->dictionary.end());
+	this->dictionary.erase(std::unique(this->dictionary.begin(), this->dictionary.end()), this->dictionary.end());
+	this->code_bits = ::code_bits(this->dictionary.size());
+	this->codes.assign(code_words(values.size(), this->code_bits), 0);
+	for (size_t k = 0; k < values.size(); ++k) {
+		const uint64_t code = std::lower_bound(this->dictionary.begin(), this->dictionary.end(), values[k]) - this->dictionary.begin();
+		const size_t bit = k * this->code_bits;
+		this->codes[bit / 64] |= code << (bit % 64);
+		if (bit % 64 + this->code_bits > 64) this->codes[bit / 64 + 1] |= code >> (64 - bit % 64);
+	}
+}
+
+uint64_t tablebase::table::code(size_t k) const {
+	const size_t bit = k * this->code_bits;
+	uint64_t ret = this->codes[bit / 64] >> (bit % 64);
+	if (bit % 64) ret |= this->codes[bit / 64 + 1] << (64 - bit % 64);
+	return ret & ((uint64_t(1) << this->code_bits) - 1);
+}
+
+std::array<uint16_t, 2> tablebase::table::at(size_t index) const {
+	const uint64_t word = this->stored[index / 64];
+	assert(word >> (index % 64) & 1);
+	return this->dictionary[this->code(this->rank[index / 64] + __builtin_popcountll(word & ((uint64_t(1) << (index % 64)) - 1)))];
+}
+
+size_t tablebase::table::bytes() const {
+	return this->stored.size() * sizeof(uint64_t) + this->rank.size() * sizeof(uint32_t) + this->dictionary.size() * sizeof(this->dictionary[0]) + this->codes.size() * sizeof(uint64_t);
+}
+
+std::optional<uint64_t> tablebase::parse_material(const std::string &signature) {
+	size_t separator = signature.find('v');
+	if (separator == std::string::npos) return std::nullopt;
+	uint64_t ret = 0;
+	for (size_t i = 0; i < signature.size(); ++i) {
+		if (i == separator) continue;
+		const char *name = std::find(TABLEBASE_PIECE_NAMES, TABLEBASE_PIECE_NAMES + 5, signature[i]);
+		if (name == TABLEBASE_PIECE_NAMES + 5) return std::nullopt;
+		const int shift = material_shift(TABLEBASE_PIECES[name - TABLEBASE_PIECE_NAMES], i < separator ? WHITE : BLACK);
+		if ((ret >> shift & 0xf) == 0xf) return std::nullopt;
+		ret += uint64_t(1) << shift;
+	}
+	for (uint8_t player : {WHITE, BLACK})
+		if (material_count(ret, KING, player) != 1) return std::nullopt;
+	if (pieces_count(ret) > MAX_PIECES) return std::nullopt;
+	return ret;
+}
+
+std::string tablebase::material_name(uint64_t material) {
+	std::string ret;
+	for (uint8_t player : {WHITE, BLACK}) {
+		if (player == BLACK) ret += 'v';
+		for (int i = 0; i < 5; ++i) ret.append(material_count(material, TABLEBASE_PIECES[i], player), TABLEBASE_PIECE_NAMES[i]);
+	}
+	return ret;
+}
+
+uint64_t tablebase::material_of(const board &b) {
+	uint64_t ret = 0;
+	for (uint8_t player : {WHITE, BLACK})
+		for (uint8_t piece : PIECE_TYPES) ret |= uint64_t(__builtin_popcountll(b.pieces(piece, player))) << material_shift(piece, player);
+	return ret;
+}
+
+uint64_t tablebase::canonical_material(uint64_t material) { //The stronger side (compared by kings, then queens, rooks...) as white
+	uint64_t white = material & PLAYER_MATERIAL_MASK, black = material >> PLAYER_MATERIAL_BITS;
+	return white >= black ? material : black | white << PLAYER_MATERIAL_BITS;
+}
+
+size_t tablebase::index(const board &b, bool mirror, bool flip) { //The images are indexed straight from the bitboards, without building them
+	size_t ret = b.get_to_move() ^ flip, multiplier = 2;
+	for (uint8_t player : {WHITE, BLACK}) {
+		for (uint8_t piece : TABLEBASE_PIECES) {
+			bitboard image = b.pieces(piece, player ^ flip);
+			if (mirror) image = mirror_files(image);
+			if (flip) image = __builtin_bswap64(image);
+			for (bitboard x = image; x; x &= x - 1) { //Identical pieces by increasing square
+				ret += multiplier * __builtin_ctzll(x);
+				multiplier *= 64;
+			}
+		}
+	}
+	return ret;
+}
+
+size_t tablebase::representative_index(const board &b, bool colour_symmetric) {
+	size_t ret = std::min(index(b), index(b, true));
+	if (colour_symmetric) ret = std::min({ret, index(b, false, true), index(b, true, true)});
+	return ret;
+}
+
+std::optional<board> tablebase::position(uint64_t material, size_t index) {
+	packed_board packed{};
+	packed.to_move = index & 1;
+	index >>= 1;
+	std::array<std::pair<int, uint8_t>, MAX_PIECES> placed; //Square and piece
+	int count = 0;
+	for (uint8_t player : {WHITE, BLACK}) {
+		for (uint8_t piece : TABLEBASE_PIECES) {
+			int previous = -1;
+			for (int i = 0; i < material_count(material, piece, player); ++i) {
+				int square = index % 64;
+				index /= 64;
+				if (square <= previous || packed.occupancy >> square & 1) return std::nullopt;
+				previous = square;
+				packed.occupancy |= bitboard(1) << square;
+				placed[count++] = {square, make_piece(piece, player)};
+			}
+		}
+	}
+	std::sort(placed.begin(), placed.begin() + count); //packed_board nibbles go by increasing square
+	for (int k = 0; k < count; ++k) packed.pieces[k / 16] |= uint64_t(placed[k].second) << (4 * (k % 16));
+	return packed.unpack();
+}
+
+bool tablebase::probeable(const board &b) {
+	return !b.get_castling_mask() && !b.get_en_passant_mask() && !b.pieces(PAWN, WHITE) && !b.pieces(PAWN, BLACK) && __builtin_popcountll(b.occupied()) <= MAX_PIECES;
+}
+
+std::optional<tablebase::value> tablebase::probe(const board &b) const {
+	if (!probeable(b)) return std::nullopt;
+	const uint64_t material = material_of(b), canonical = canonical_material(material);
+	auto found = this->tables.find(canonical);
+	if (found == this->tables.end()) return std::nullopt;
+	return unscale(found->second.at(representative_index(material == canonical ? b : b.flip(), (canonical & PLAYER_MATERIAL_MASK) == canonical >> PLAYER_MATERIAL_BITS)));
+}
+
+bool tablebase::contains(uint64_t material) const {
+	return this->tables.count(canonical_material(material));
+}
+
+std::vector<uint64_t> tablebase::materials() const {
+	std::vector<uint64_t> ret;
+	for (auto &[material, _] : this->tables) ret.push_back(material);
+	return ret;
+}
+
+tablebase::value tablebase::backed_up(const board &b) const { //Written apart from generate()'s encoded successors, to check them
+	value ret;
+	movelist moves = b.generate_moves_lazily();
+	for (const dice_roll &dice : full_dice_rolls) {
+		const double p = dice.combinations() / (double)OMEGA;
+		const move_range &roll_moves = moves.get_moves(dice);
+		if (roll_moves.empty()) { //Captures the king
+			ret.win += p;
+			continue;
+		}
+		double best = 0; //Of the side moving
+		value best_child;
+		for (const board &child : roll_moves) {
+			const value v = *this->probe(child);
+			if (1 - v.score() >= best) {
+				best = 1 - v.score();
+				best_child = v;
+			}
+		}
+		ret.win += p * best_child.loss;
+		ret.loss += p * best_child.win;
+	}
+	return ret;
+}
+
+std::optional<double> tablebase::max_residual(uint64_t material, size_t samples) const {
+	material = canonical_material(material);
+	if (!this->tables.count(material)) return std::nullopt;
+	const size_t size = table_size(material);
+	double ret = 0;
+	for (size_t k = 0, checked = 0; checked < samples && k < size; ++k) {
+		std::optional<board> b = position(material, samples < size ? splitmix64(k) % size : k);
+		if (!b) continue;
+		checked++;
+		ret = std::max(ret, std::abs(this->backed_up(*b).score() - this->probe(*b)->score()));
+	}
+	return ret;
+}
+
+void tablebase::generate(uint64_t material, const tablebase_generation_options &options) {
+	material = canonical_material(material);
+	if (this->tables.count(material)) return;
+	for (uint8_t player : {WHITE, BLACK}) //Captures lead to these
+		for (uint8_t piece : TABLEBASE_PIECES)
+			if (piece != KING && material_count(material, piece, player))
+				this->generate(material - (uint64_t(1) << material_shift(piece, player)), options);
+
+	const size_t size = table_size(material);
+	const int count = pieces_count(material);
+	const bool colour_symmetric = (material & PLAYER_MATERIAL_MASK) == material >> PLAYER_MATERIAL_BITS;
+	std::vector<std::array<float, 2>> values(size, {0, 0}); //Win and loss, from 0 (nothing decided yet) and updated in place (Gauss-Seidel) until they settle
+	std::vector<uint64_t> stored(size / 64, 0); //Representatives, found in the first iteration
+	std::array<double, DICE_ROLL_LENGTH> probability;
+	for (const dice_roll &dice : full_dice_rolls) probability[dice.encode()] = dice.combinations() / (double)OMEGA;
+
+	//Only representatives (see representative_index()) are iterated on and stored, successors point to them too.
+	//Successors are generated once and kept while options.successor_cache_bytes allows, positions beyond that are generated again every iteration.
+	//Per position, for every full roll: the number of moves (0 when it captures the king), then the moves, as an index into this table or EXTERNAL | an index into the values of the other tables.
+	const uint32_t EXTERNAL = uint32_t(1) << 31;
+	const uint32_t NOT_CACHED = UINT32_MAX;
+	std::vector<uint32_t> cache, scratch;
+	std::vector<value> cache_external, scratch_external;
+	std::vector<uint32_t> cache_begin(size, NOT_CACHED);
+	auto encode = [&](const board &b, std::vector<uint32_t> &out, std::vector<value> &external) {
+		movelist moves = b.generate_moves_lazily();
+		for (const dice_roll &dice : full_dice_rolls) {
+			const move_range &roll_moves = moves.get_moves(dice);
+			out.push_back(roll_moves.size());
+			for (const board &child : roll_moves) {
+				if (__builtin_popcountll(child.occupied()) == count) out.push_back(representative_index(child, colour_symmetric)); //No capture, same table and orientation
+				else {
+					std::optional<value> v = this->probe(child);
+					assert(v);
+					out.push_back(EXTERNAL | external.size());
+					external.push_back(*v);
+				}
+			}
+		}
+	};
+	auto evaluate = [&](const uint32_t *encoded, const std::vector<value> &external) -> value {
+		value ret;
+		for (const dice_roll &dice : full_dice_rolls) {
+			const double p = probability[dice.encode()];
+			const uint32_t moves_count = *encoded++;
+			if (!moves_count) { //Captures the king
+				ret.win += p;
+				continue;
+			}
+			value best = {1, 0}; //Worst possible for the side moving, the child's side to move winning
+			for (uint32_t k = 0; k < moves_count; ++k, ++encoded) {
+				value v = *encoded & EXTERNAL ? external[*encoded & ~EXTERNAL] : value{values[*encoded][0], values[*encoded][1]};
+				if (v.loss - v.win > best.loss - best.win) best = v;
+			}
+			ret.win += p * best.loss;
+			ret.loss += p * best.win;
+		}
+		return ret;
+	};
+
+	for (int iteration = 1; iteration <= options.max_iterations; ++iteration) {
+		double max_change = 0;
+		for (size_t i = 0; i < size; ++i) {
+			value v;
+			if (iteration > 1 && !(stored[i / 64] >> (i % 64) & 1)) continue; //Not a position or not a representative
+			if (cache_begin[i] != NOT_CACHED) v = evaluate(cache.data() + cache_begin[i], cache_external);
+			else {
+				std::optional<board> b = position(material, i); //Decoded again, a table of boards would be far bigger than the values
+				if (!b || representative_index(*b, colour_symmetric) != i) continue;
+				stored[i / 64] |= uint64_t(1) << (i % 64);
+				scratch.clear();
+				scratch_external.clear();
+				encode(*b, scratch, scratch_external);
+				v = evaluate(scratch.data(), scratch_external);
+				const size_t cached_bytes = (cache.size() + scratch.size()) * sizeof(uint32_t) + (cache_external.size() + scratch_external.size()) * sizeof(value);
+				if (iteration == 1 && cached_bytes <= options.successor_cache_bytes && cache.size() < NOT_CACHED && cache_external.size() + scratch_external.size() < EXTERNAL) {
+					cache_begin[i] = cache.size();
+					for (uint32_t x : scratch) cache.push_back(x & EXTERNAL ? EXTERNAL | ((x & ~EXTERNAL) + cache_external.size()) : x);
+					cache_external.insert(cache_external.end(), scratch_external.begin(), scratch_external.end());
+				}
+			}
+			max_change = std::max(max_change, std::abs((v.win - v.loss) - (values[i][0] - values[i][1])) / 2); //Win and loss alone can keep switching between equally scored moves
+			values[i] = {(float)v.win, (float)v.loss};
+		}
+		if (options.progress) *options.progress << material_name(material) << ": iteration " << iteration << ", max change " << max_change << ", " << (cache.size() * sizeof(uint32_t) + cache_external.size() * sizeof(value)) / (1 << 20) << "MiB of cached successors" << std::endl;
+		if (max_change <= options.tolerance) break;
+	}
+
+	std::vector<std::array<uint16_t, 2>> scaled;
+	for (size_t i = 0; i < size; ++i)
+		if (stored[i / 64] >> (i % 64) & 1) scaled.push_back({(uint16_t)std::lround(std::clamp(values[i][0], 0.0f, 1.0f) * VALUE_SCALE), (uint16_t)std::lround(std::clamp(values[i][1], 0.0f, 1.0f) * VALUE_SCALE)});
+	table &result = this->tables[material];
+	result.stored = std::move(stored);
+	result.build_rank();
+	result.pack(scaled);
+	if (options.progress) *options.progress << material_name(material) << ": " << scaled.size() << " of " << size << " indices stored, " << result.dictionary.size() << " distinct values, " << result.bytes() / 1024 << "KiB" << std::endl;
+}
+
+bool tablebase::save(const std::string &path) const { //Magic, version, table count, then for each table its material, stored bitmap, dictionary size and dictionary, codes, little endian as in memory
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) return false;
+	const uint32_t version = TABLEBASE_VERSION, tables_count = this->tables.size();
+	bool ok = fwrite(TABLEBASE_MAGIC.data(), TABLEBASE_MAGIC.size(), 1, file) == 1 && fwrite(&version, sizeof(version), 1, file) == 1 && fwrite(&tables_count, sizeof(tables_count), 1, file) == 1;
+	for (auto &[material, t] : this->tables) {
+		const uint32_t dictionary_size = t.dictionary.size();
+		ok = ok && fwrite(&material, sizeof(material), 1, file) == 1 && fwrite(t.stored.data(), sizeof(t.stored[0]), t.stored.size(), file) == t.stored.size();
+		ok = ok && fwrite(&dictionary_size, sizeof(dictionary_size), 1, file) == 1 && fwrite(t.dictionary.data(), sizeof(t.dictionary[0]), t.dictionary.size(), file) == t.dictionary.size();
+		ok = ok && fwrite(t.codes.data(), sizeof(t.codes[0]), t.codes.size(), file) == t.codes.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+std::optional<tablebase> tablebase::load(const std::string &path, std::string &error) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		error = "can't open " + path;
+		return std::nullopt;
+	}
+	tablebase ret;
+	std::array<char, 8> magic;
+	uint32_t version = 0, tables_count = 0;
+	if (fread(magic.data(), magic.size(), 1, file) != 1 || magic != TABLEBASE_MAGIC) error = path + " is not a tablebase";
+	else if (fread(&version, sizeof(version), 1, file) != 1 || version != TABLEBASE_VERSION) error = path + " has an unsupported version";
+	else if (fread(&tables_count, sizeof(tables_count), 1, file) != 1) error = path + " is truncated";
+	for (uint32_t i = 0; error.empty() && i < tables_count; ++i) {
+		uint64_t material;
+		if (fread(&material, sizeof(material), 1, file) != 1 || canonical_material(material) != material || pieces_count(material) > MAX_PIECES) {
+			error = path + " has a bad table header";
+			break;
+		}
+		table &t = ret.tables[material];
+		t.stored.resize(table_size(material) / 64);
+		uint32_t dictionary_size = 0;
+		if (fread(t.stored.data(), sizeof(t.stored[0]), t.stored.size(), file) != t.stored.size() || fread(&dictionary_size, sizeof(dictionary_size), 1, file) != 1) {
+			error = path + " is truncated";
+			break;
+		}
+		t.build_rank();
+		const size_t stored_count = t.rank.back() + __builtin_popcountll(t.stored.back());
+		if (dictionary_size > stored_count || (stored_count && !dictionary_size)) {
+			error = path + " has a bad table header";
+			break;
+		}
+		t.dictionary.resize(dictionary_size);
+		t.code_bits = code_bits(dictionary_size);
+		t.codes.resize(code_words(stored_count, t.code_bits));
+		if (fread(t.dictionary.data(), sizeof(t.dictionary[0]), t.dictionary.size(), file) != t.dictionary.size() || fread(t.codes.data(), sizeof(t.codes[0]), t.codes.size(), file) != t.codes.size()) {
+			error = path + " is truncated";
+			break;
+		}
+		for (size_t k = 0; k < stored_count; ++k) //Codes past the dictionary would read out of it
+			if (t.code(k) >= dictionary_size) {
+				error = path + " has a corrupt table";
+				break;
+			}
+	}
+	fclose(file);
+	if (!error.empty()) return std::nullopt;
+	return ret;
+}
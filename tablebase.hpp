@@ -0,0 +1,78 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+#include <array>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "board.hpp"
+
+struct tablebase_generation_options {
+	double tolerance = 1e-6; ///< Stop iterating once no score changed by more than that, floats don't get much below 1e-7
+	int max_iterations = 1000;
+	size_t successor_cache_bytes = size_t(1) << 30; ///< Memory for keeping generated successors between iterations, instead of generating them again: 4 bytes per successor, 16 more for captures (at most 16GiB, offsets are 32 bits)
+	std::ostream *progress = nullptr;
+};
+
+/// Exact values of small pawnless endgames without castling rights or en passant, computed by value iteration with generate_moves as the successor function.
+/// The value of a position is the pair of probabilities that the side to move captures the king (win) or gets its own king captured (loss), play that never ends is neither.
+/// Both sides maximize wins minus losses, that is their expected score with never ending play counted as half a point.
+/// Only that score is exact, win and loss are those of one of the best moves and can shift between moves of equal score.
+/// A table covers one material set (both colour orientations, through board::flip) with both sides to move, indexed by the squares of the pieces.
+/// Only representatives (see representative_index()) are stored, as codes of just enough bits into the table's sorted distinct values, found through a bitmap of the stored indices with a rank per word.
+/// That is 1.5 bits per index plus a code for about a half (a quarter for colour symmetric material) of them, instead of 4 bytes per index: 2 * 64^4 indices make 134MB flat.
+/// Generating a table takes 12 bytes per index (400MB for four pieces) besides the successor cache.
+class tablebase {
+public:
+	static constexpr int MAX_PIECES = 4; ///< Including the kings, 2 * 64^4 entries is the largest table
+	static constexpr uint16_t VALUE_SCALE = UINT16_MAX; ///< Stored probabilities are rounded to multiples of 1 / VALUE_SCALE
+
+	struct value {
+		double win = 0;
+		double loss = 0;
+		double score() const {return (1 + this->win - this->loss) / 2;} ///< In [0, 1] like expectimax_search values
+	};
+
+	/// "KRvK" style names, pieces from KQRBN, the kings included
+	static std::optional<uint64_t> parse_material(const std::string &signature);
+	static std::string material_name(uint64_t material);
+
+	/// Generates the table for the material (and first the tables it can reach by captures), nothing is done for tables already present
+	void generate(uint64_t material, const tablebase_generation_options &options = {});
+	std::optional<value> probe(const board &b) const; ///< nullopt when no table covers b
+	bool contains(uint64_t material) const;
+	std::vector<uint64_t> materials() const;
+	/// Largest difference between a stored score and one ply of play over the tables (the equation generation iterates on), about the tolerance plus 1 / VALUE_SCALE for a converged table.
+	/// Over every position of the table when samples covers it, otherwise over that many random positions; nullopt when the table is missing
+	std::optional<double> max_residual(uint64_t material, size_t samples) const;
+
+	bool save(const std::string &path) const;
+	static std::optional<tablebase> load(const std::string &path, std::string &error);
+
+private:
+	struct table {
+		std::vector<uint64_t> stored; ///< Bit i set when index i has a code
+		std::vector<uint32_t> rank; ///< Per word of stored, the bits set in the words before it
+		std::vector<std::array<uint16_t, 2>> dictionary; ///< Distinct win and loss pairs scaled by VALUE_SCALE, sorted
+		int code_bits = 0;
+		std::vector<uint64_t> codes; ///< code_bits per stored index by increasing index, then a padding word so a code can always be read from two words
+		void build_rank();
+		void pack(const std::vector<std::array<uint16_t, 2>> &values); ///< Values of the stored indices in order, sets everything but stored and rank
+		uint64_t code(size_t k) const; ///< Of the k-th stored index
+		std::array<uint16_t, 2> at(size_t index) const; ///< For stored indices only
+		size_t bytes() const;
+	};
+	std::map<uint64_t, table> tables; ///< By canonical material
+
+	static uint64_t material_of(const board &b); ///< 4 bits per piece type and colour
+	static uint64_t canonical_material(uint64_t material);
+	static size_t index(const board &b, bool mirror = false, bool flip = false); ///< Of b (or its image by flip_horizontally_in_place / flip) in the table of its material, which must be canonical (flip b first otherwise)
+	static size_t representative_index(const board &b, bool colour_symmetric); ///< Smallest index of the positions symmetric to b in its table, they all have the same value, flips stay in the table only for colour_symmetric material
+	static std::optional<board> position(uint64_t material, size_t index); ///< nullopt for indices that aren't a position (shared squares, identical pieces out of order)
+	static value unscale(const std::array<uint16_t, 2> &x) {return {x[0] / (double)VALUE_SCALE, x[1] / (double)VALUE_SCALE};}
+	static bool probeable(const board &b);
+	value backed_up(const board &b) const; ///< From probes of every successor of b, which must all be covered
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "../attacks.hpp"
+#include "../splitmix.hpp"
+#include "test_utils.hpp"
+int main() {
+	uint64_t seed = 0;
+	int rook_mismatches = 0, bishop_mismatches = 0;
+	for (int square = 0; square < SQUARES_COUNT; ++square) {
+		for (int _ = 0; _ < 1000; ++_) {
+			bitboard a = splitmix64(seed++);
+			bitboard b = splitmix64(seed++);
+			bitboard occupied = a & b;
+			if (rook_attacks(square, occupied) != slow_rook_attacks(square, occupied)) rook_mismatches++;
+			if (bishop_attacks(square, occupied) != slow_bishop_attacks(square, occupied)) bishop_mismatches++;
+		}
+	}
+	ASSERT_EQUAL(rook_mismatches, 0);
+	ASSERT_EQUAL(bishop_mismatches, 0);
+	ASSERT_EQUAL(rook_attacks(square_index(0, 0), square_bit(0, 3) | square_bit(5, 0)), square_bit(0, 1) | square_bit(0, 2) | square_bit(0, 3) | square_bit(1, 0) | square_bit(2, 0) | square_bit(3, 0) | square_bit(4, 0) | square_bit(5, 0));
+	ASSERT_EQUAL(bishop_attacks(square_index(3, 3), 0), rays[2][square_index(3, 3)] | rays[3][square_index(3, 3)] | rays[6][square_index(3, 3)] | rays[7][square_index(3, 3)]);
+}
@@ -0,0 +1,49 @@
+#include "../exact_playout.hpp"
+#include "test_utils.hpp"
+#include <cmath>
+exact_playout::outcome naive(const board &b, int plies) { //The same expectation without memoisation or the depth 1 shortcut
+	if (plies == 0) return {};
+	exact_playout::outcome ret = {0, 0, 0};
+	movelist moves = b.generate_moves();
+	for (const dice_roll &dice : full_dice_rolls) {
+		const double probability = dice.combinations() / (double)OMEGA;
+		const move_range &roll_moves = moves.get_moves(dice);
+		if (roll_moves.empty()) ret.won += probability;
+		for (const board &child : roll_moves) {
+			exact_playout::outcome child_outcome = naive(child, plies - 1);
+			ret.won += probability / roll_moves.size() * child_outcome.lost;
+			ret.lost += probability / roll_moves.size() * child_outcome.won;
+			ret.still_playing += probability / roll_moves.size() * child_outcome.still_playing;
+		}
+	}
+	return ret;
+}
+bool close(const exact_playout::outcome &a, const exact_playout::outcome &b) {
+	return std::abs(a.won - b.won) < 1e-12 && std::abs(a.lost - b.lost) < 1e-12 && std::abs(a.still_playing - b.still_playing) < 1e-12;
+}
+int main() {
+	const board adjacent = parse_fen(ADJACENT_KINGS_FEN);
+	exact_playout evaluator;
+	for (int plies = 1; plies <= 3; ++plies) {
+		const adjacent_kings_outcome expected = adjacent_kings(plies);
+		CHECK_CASE(close(evaluator.evaluate(adjacent, plies), {expected.won, expected.lost, expected.still_playing}), describe(ADJACENT_KINGS_FEN, "plies", plies));
+	}
+
+	for (const char *fen : {"k7/8/8/8/8/8/8/7K w - - 0 1", "8/8/2k5/8/2K5/8/8/8 b - - 0 1", "4k3/8/8/8/8/8/8/1N2K3 w - - 0 1", "4k3/8/8/3r4/8/8/8/2R1K3 w - - 0 1"}) {
+		const board b = parse_fen(fen);
+		exact_playout memoised;
+		for (int plies = 1; plies <= 3; ++plies) {
+			exact_playout::outcome result = memoised.evaluate(b, plies), flipped = memoised.evaluate(b.flip(), plies);
+			CHECK_CASE((plies > 2 || close(result, naive(b, plies))) && close(result, flipped) && std::abs(result.won + result.lost + result.still_playing - 1) <= 1e-12, describe(fen, "plies", plies));
+		}
+	}
+
+	tablebase tables;
+	tables.generate(*tablebase::parse_material("KvK"));
+	exact_playout with_tables(&tables);
+	tablebase::value known = *tables.probe(adjacent);
+	exact_playout::outcome probed = with_tables.evaluate(adjacent, 4);
+	ASSERT_EQUAL(probed.won, known.win);
+	ASSERT_EQUAL(probed.lost, known.loss);
+	ASSERT_EQUAL(with_tables.evaluate(adjacent, 0).still_playing, 1.0);
+}
@@ -0,0 +1,43 @@
+#include "../expectimax.hpp"
+#include "test_utils.hpp"
+#include <cmath>
+using namespace std::chrono_literals;
+int main() {
+	board equal = parse_fen("4k3/3p4/8/8/8/8/3P4/4K3 w - - 0 1");
+	ASSERT_EQUAL(expectimax_search::evaluate(equal), 0.5);
+	ASSERT_EQUAL(expectimax_search::evaluate(parse_fen("4k3/8/8/8/8/8/3Q4/4K3 w - - 0 1")) > 0.5, true);
+	ASSERT_EQUAL(expectimax_search::evaluate(parse_fen("4k3/8/8/8/8/8/3Q4/4K3 b - - 0 1")) < 0.5, true);
+
+	//No captures possible in one move, so every non-winning roll is worth exactly 1 - 0.5
+	double winning = equal.generate_moves().count_winning_on_the_spot() / (double)OMEGA;
+	expectimax_search engine(12);
+	expectimax_search::result r = engine.search(equal, 10s, 1);
+	ASSERT_EQUAL(r.depth, 1);
+	ASSERT_EQUAL(std::abs(r.value - (winning + (1 - winning) * 0.5)) < 1e-9, true);
+
+	board close = parse_fen("8/8/8/3k4/3K4/8/8/8 w - - 0 1");
+	r = engine.search(close, parse_dice_roll("KPP"), 10s, 2);
+	ASSERT_EQUAL(r.value, 1.0);
+	ASSERT_EQUAL(r.best_move.has_value(), false);
+
+	board hanging = parse_fen("4k3/8/8/8/8/2q5/8/1N2K3 w - - 0 1");
+	r = engine.search(hanging, parse_dice_roll("NPP"), 10s, 1);
+	ASSERT_EQUAL(r.best_move.has_value(), true);
+	ASSERT_EQUAL(r.best_move->pieces(QUEEN, BLACK), bitboard(0)); //Knight takes the queen
+
+	expectimax_search fresh(12), reused(12);
+	board middle = parse_fen("4k3/8/3n4/8/8/3B4/8/4K3 w - - 0 1");
+	reused.search(middle, 10s, 1);
+	ASSERT_EQUAL(fresh.search(middle, 10s, 2).value, reused.search(middle, 10s, 2).value);
+
+	for (const char *fen : {"4k3/8/3n4/8/8/3B4/8/4K3 w - - 0 1", "4k3/pp6/8/8/8/2R5/5PP1/4K3 b - - 0 1", "3rk3/8/8/8/8/8/8/R3K3 w Q - 0 1"}) {
+		board b = parse_fen(fen);
+		expectimax_search pruned(14), full(14, false);
+		expectimax_search::result with_pruning = pruned.search(b, 100s, 2), without_pruning = full.search(b, 100s, 2);
+		CHECK_CASE(std::abs(with_pruning.value - without_pruning.value) <= 1e-6, describe(fen, "before rolling:", with_pruning.value, "pruned,", without_pruning.value, "full"));
+		const dice_roll dice = parse_dice_roll("RPK");
+		with_pruning = pruned.search(b, dice, 100s, 2);
+		without_pruning = full.search(b, dice, 100s, 2);
+		CHECK_CASE(std::abs(with_pruning.value - without_pruning.value) <= 1e-6, describe(fen, "with", dice, ":", with_pruning.value, "pruned,", without_pruning.value, "full"));
+	}
+}
@@ -0,0 +1,43 @@
+#include "../board.hpp"
+#include "test_utils.hpp"
+std::string parse_error(std::string_view fen) {
+	board b;
+	return fen_error_message(try_parse_fen(fen, b));
+}
+int main() {
+	for (const std::string &fen : SAMPLE_FENS) {
+		movelist moves = parse_fen(fen).generate_moves();
+		for (const dice_roll &dice : full_and_partial_dice_rolls) {
+			for (const board &x : moves.get_moves(dice)) {
+				char buffer[MAX_FEN_LENGTH];
+				std::string_view written(buffer, x.write_fen(buffer));
+				board parsed;
+				CHECK_CASE(written == x.fen() && try_parse_fen(written, parsed) == fen_error::NONE && parsed == x && parsed.hash() == x.hash(), describe(x.fen(), "from", fen, "with", dice));
+			}
+		}
+	}
+	ASSERT_EQUAL(parse_fen("K6k/8/8/8/PpPpP3/8/8/8 b - a3,c3,e3").fen(), std::string("K6k/8/8/8/PpPpP3/8/8/8 b - a3,c3,e3"));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w - - 0 1"), std::string(fen_error_message(fen_error::NONE)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w -"), std::string(fen_error_message(fen_error::FIELD_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w - - 0 1 x"), std::string(fen_error_message(fen_error::FIELD_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/K7 w - - 0 1"), std::string(fen_error_message(fen_error::RANK_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/8/K7 w - - 0 1"), std::string(fen_error_message(fen_error::RANK_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K8 w - - 0 1"), std::string(fen_error_message(fen_error::RANK_LENGTH)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/7/K7 w - - 0 1"), std::string(fen_error_message(fen_error::RANK_LENGTH)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/X7 w - - 0 1"), std::string(fen_error_message(fen_error::PIECE)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 x - - 0 1"), std::string(fen_error_message(fen_error::TO_MOVE)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w Kx - 0 1"), std::string(fen_error_message(fen_error::CASTLING)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w - e3 0 1"), std::string(fen_error_message(fen_error::EN_PASSANT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w - e6, 0 1"), std::string(fen_error_message(fen_error::EN_PASSANT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K7 w - e6;d6 0 1"), std::string(fen_error_message(fen_error::EN_PASSANT)));
+	ASSERT_EQUAL(parse_error("8/8/8/8/8/8/8/K7 w - - 0 1"), std::string(fen_error_message(fen_error::KING_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/KK6 w - - 0 1"), std::string(fen_error_message(fen_error::KING_COUNT)));
+	ASSERT_EQUAL(parse_error("7k/8/8/8/8/8/8/K6p w - - 0 1"), std::string(fen_error_message(fen_error::PAWN_RANK)));
+	ASSERT_EQUAL(parse_error("P6k/8/8/8/8/8/8/K7 w - - 0 1"), std::string(fen_error_message(fen_error::PAWN_RANK)));
+	ASSERT_EQUAL(parse_error("nnnnnnnk/nnnnnnnn/8/8/8/8/NNNNNNNN/NNNNNNNK w - - 0 1"), std::string(fen_error_message(fen_error::NONE)));
+	ASSERT_EQUAL(parse_error("nnnnnnnk/nnnnnnnn/n7/8/8/8/NNNNNNNN/NNNNNNNK w - - 0 1"), std::string(fen_error_message(fen_error::PIECE_COUNT)));
+	ASSERT_EQUAL(parse_error("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"), std::string(fen_error_message(fen_error::NONE)));
+	ASSERT_EQUAL(parse_error("4k3/8/8/8/8/8/8/4K3 w K - 0 1"), std::string(fen_error_message(fen_error::CASTLING_PIECES)));
+	ASSERT_EQUAL(parse_error("r3k2r/8/8/8/8/8/8/R3K1R1 w Kq - 0 1"), std::string(fen_error_message(fen_error::CASTLING_PIECES)));
+	ASSERT_EQUAL(parse_error("r3k2r/8/8/8/8/8/8/R4K1R w Q - 0 1"), std::string(fen_error_message(fen_error::CASTLING_PIECES)));
+}
@@ -0,0 +1,37 @@
+#include "../board.hpp"
+#include "test_utils.hpp"
+#include <set>
+#include <vector>
+int main() {
+	std::vector<std::string> fens(std::begin(SAMPLE_FENS), std::end(SAMPLE_FENS));
+	fens.push_back("4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1");
+	fens.push_back("rnb1kbnr/pppp1ppp/8/4p3/5PPq/8/PPPPP2P/RNBQKBNR w KQkq - 0 1");
+	int positions = 0;
+	for (const std::string &fen : fens) {
+		board b = parse_fen(fen);
+		for (int ply = 0; ply < 6; ++ply) { //Walk a few plies down to also cover positions not written by hand
+			movelist eager = b.generate_moves();
+			movelist lazy = b.generate_moves_lazily(), lazy_counted_first = b.generate_moves_lazily();
+			positions++;
+			const std::string at = b.fen();
+			std::bitset<DICE_ROLL_LENGTH> king_captures = b.king_capture_rolls();
+			for (const dice_roll &dice : full_and_partial_dice_rolls)
+				CHECK_CASE(king_captures[dice.encode()] == eager.get_moves(dice).empty(), describe(at, "with", dice));
+			CHECK_CASE(lazy_counted_first.count_winning_on_the_spot() == eager.count_winning_on_the_spot(), at);
+			for (const dice_roll &dice : full_and_partial_dice_rolls) {
+				std::set<board> expected(eager.get_moves(dice).begin(), eager.get_moves(dice).end());
+				CHECK_CASE(std::set<board>(lazy.get_moves(dice).begin(), lazy.get_moves(dice).end()) == expected, describe(at, "with", dice));
+				CHECK_CASE(std::set<board>(lazy_counted_first.get_moves(dice).begin(), lazy_counted_first.get_moves(dice).end()) == expected, describe(at, "with", dice));
+			}
+			CHECK_CASE(lazy.count_winning_on_the_spot() == eager.count_winning_on_the_spot(), at);
+			const board *next = nullptr;
+			for (const dice_roll &dice : full_dice_rolls) {
+				const move_range &moves = eager.get_moves(dice);
+				if (!moves.empty()) next = &moves[(ply * 7) % moves.size()];
+			}
+			if (!next) break;
+			b = *next;
+		}
+	}
+	ASSERT_EQUAL(positions > 20, true);
+}
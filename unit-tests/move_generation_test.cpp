@@ -1,5 +1,6 @@
 #include "test_utils.hpp"
 #include "../board.hpp"
+#include "../packed_board.hpp"
 #include <bits/stdc++.h>
 
 std::vector<board> passed_tests;
@@ -41,7 +42,8 @@ void assert_move_equal_impl(int line, const std::string &fen, const std::string
 				orientations_count++;
 				board b = b0;
 				if (shift) b.shift_in_place(shift_length);
-				auto got_moves = b.generate_moves().get_moves(dice);
+				movelist generated = b.generate_moves();
+				auto got_moves = generated.get_moves(dice);
 				std::set<board> expected_boards;
 				for (auto &expected_fen : expected_fens) {
 					board expected = parse_fen(expected_fen);
@@ -264,6 +266,15 @@ int main() {
 	ASSERT_MOVES_EQUAL("4k3/8/8/8/8/8/6p1/4K2R b K - 0 1", "PPP", {"4k3/8/8/8/8/8/8/4K2n w - -", "4k3/8/8/8/8/8/8/4K2b w - -", "4k3/8/8/8/8/8/8/4K2r w - -", "4k3/8/8/8/8/8/8/4K2q w - -", "4k3/8/8/8/8/8/8/4K1nR w K -", "4k3/8/8/8/8/8/8/4K1bR w K -", "4k3/8/8/8/8/8/8/4K1rR w K -", "4k3/8/8/8/8/8/8/4K1qR w K -"});
 	ASSERT_MOVES_EQUAL("rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B2N1/1PPP1PP1/3QK1RR w Kkq - 0 1", "BNK", {"rnbqkbnr/pppppppp/8/5P1P/2P1P3/6N1/1PPPKPP1/3Q1BRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/6N1/1PPPBPP1/3Q1KRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B4/1PPPKPP1/3Q1NRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B4/1PPPNPP1/3Q1KRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/8/1PPPBPP1/3QKNRR b Kkq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/8/1PPPNPP1/3QKBRR b Kkq -"});
 	ASSERT_MOVES_EQUAL("rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B2N1/1PPP1PP1/3QK1RR w kq - 0 1", "BNK", {"rnbqkbnr/pppppppp/8/5P1P/2P1P3/6N1/1PPPKPP1/3Q1BRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/6N1/1PPPBPP1/3Q1KRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B4/1PPPKPP1/3Q1NRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/3B4/1PPPNPP1/3Q1KRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/8/1PPPBPP1/3QKNRR b kq -", "rnbqkbnr/pppppppp/8/5P1P/2P1P3/8/1PPPNPP1/3QKBRR b kq -"});
+	{ //Castling right without the rook (nor, after the king moves, the king): FENs reject it, packed boards can still carry it
+		packed_board packed = packed_board::pack(parse_fen("4k3/8/8/8/8/8/8/4K3 w - - 0 1"));
+		packed.castling_mask = WHITE_KINGSIDE_CASTLE;
+		movelist moves = packed.unpack().generate_moves();
+		std::set<board> got, expected;
+		for (const board &x : moves.get_moves(parse_dice_roll("KRB"))) got.insert(x);
+		for (const char *fen : {"4k3/8/8/8/8/8/3K4/8 b - -", "4k3/8/8/8/8/8/4K3/8 b - -", "4k3/8/8/8/8/8/5K2/8 b - -", "4k3/8/8/8/8/8/8/3K4 b - -", "4k3/8/8/8/8/8/8/5K2 b - -"}) expected.insert(parse_fen(fen));
+		ASSERT_EQUAL(got == expected, true);
+	}
 	ASSERT_MOVES_EQUAL("4k3/8/8/8/8/7P/8/4K2R w K - 0 1", "RKB", {"4k3/8/8/8/8/7P/5K1R/8 b - -", "4k3/8/8/8/8/7P/4K2R/8 b - -", "4k3/8/8/8/8/7P/3K3R/8 b - -", "4k3/8/8/8/8/7P/5K2/6R1 b - -", "4k3/8/8/8/8/7P/4K3/6R1 b - -", "4k3/8/8/8/8/7P/3K4/6R1 b - -", "4k3/8/8/8/8/7P/5K2/5R2 b - -", "4k3/8/8/8/8/7P/4K3/5R2 b - -", "4k3/8/8/8/8/7P/3K4/5R2 b - -", "4k3/8/8/8/8/7P/8/5RK1 b - -", "4k3/8/8/8/8/7P/7R/5K2 b - -", "4k3/8/8/8/8/7P/8/5KR1 b - -", "4k3/8/8/8/8/7P/5K2/4R3 b - -", "4k3/8/8/8/8/7P/4K3/4R3 b - -", "4k3/8/8/8/8/7P/3K4/4R3 b - -", "4k3/8/8/8/8/7P/5K2/3R4 b - -", "4k3/8/8/8/8/7P/4K3/3R4 b - -", "4k3/8/8/8/8/7P/3K4/3R4 b - -", "4k3/8/8/8/8/7P/7R/3K4 b - -", "4k3/8/8/8/8/7P/8/3K2R1 b - -", "4k3/8/8/8/8/7P/8/3K1R2 b - -", "4k3/8/8/8/8/7P/8/3KR3 b - -", "4k3/8/8/8/8/7P/5K2/2R5 b - -", "4k3/8/8/8/8/7P/4K3/2R5 b - -", "4k3/8/8/8/8/7P/3K4/2R5 b - -", "4k3/8/8/8/8/7P/5K2/1R6 b - -", "4k3/8/8/8/8/7P/4K3/1R6 b - -", "4k3/8/8/8/8/7P/3K4/1R6 b - -", "4k3/8/8/8/8/7P/5K2/R7 b - -", "4k3/8/8/8/8/7P/4K3/R7 b - -", "4k3/8/8/8/8/7P/3K4/R7 b - -"});
 	ASSERT_MOVES_EQUAL("4k3/8/8/8/8/7P/8/4K2R w - - 0 1", "RKB", {"4k3/8/8/8/8/7P/5K1R/8 b - -", "4k3/8/8/8/8/7P/4K2R/8 b - -", "4k3/8/8/8/8/7P/3K3R/8 b - -", "4k3/8/8/8/8/7P/5K2/6R1 b - -", "4k3/8/8/8/8/7P/4K3/6R1 b - -", "4k3/8/8/8/8/7P/3K4/6R1 b - -", "4k3/8/8/8/8/7P/5K2/5R2 b - -", "4k3/8/8/8/8/7P/4K3/5R2 b - -", "4k3/8/8/8/8/7P/3K4/5R2 b - -", "4k3/8/8/8/8/7P/7R/5K2 b - -", "4k3/8/8/8/8/7P/8/5KR1 b - -", "4k3/8/8/8/8/7P/5K2/4R3 b - -", "4k3/8/8/8/8/7P/4K3/4R3 b - -", "4k3/8/8/8/8/7P/3K4/4R3 b - -", "4k3/8/8/8/8/7P/5K2/3R4 b - -", "4k3/8/8/8/8/7P/4K3/3R4 b - -", "4k3/8/8/8/8/7P/3K4/3R4 b - -", "4k3/8/8/8/8/7P/7R/3K4 b - -", "4k3/8/8/8/8/7P/8/3K2R1 b - -", "4k3/8/8/8/8/7P/8/3K1R2 b - -", "4k3/8/8/8/8/7P/8/3KR3 b - -", "4k3/8/8/8/8/7P/5K2/2R5 b - -", "4k3/8/8/8/8/7P/4K3/2R5 b - -", "4k3/8/8/8/8/7P/3K4/2R5 b - -", "4k3/8/8/8/8/7P/5K2/1R6 b - -", "4k3/8/8/8/8/7P/4K3/1R6 b - -", "4k3/8/8/8/8/7P/3K4/1R6 b - -", "4k3/8/8/8/8/7P/5K2/R7 b - -", "4k3/8/8/8/8/7P/4K3/R7 b - -", "4k3/8/8/8/8/7P/3K4/R7 b - -"});
 	ASSERT_MOVES_EQUAL("4k3/8/8/8/8/7P/8/4Kb1R w K - 0 1", "RKB", {"4k3/8/8/8/8/7P/5K1R/5b2 b - -", "4k3/8/8/8/8/7P/4K2R/5b2 b - -", "4k3/8/8/8/8/7P/3K3R/5b2 b - -", "4k3/8/8/8/8/7P/5K2/5bR1 b - -", "4k3/8/8/8/8/7P/4K3/5bR1 b - -", "4k3/8/8/8/8/7P/3K4/5bR1 b - -", "4k3/8/8/8/8/7P/5K2/5R2 b - -", "4k3/8/8/8/8/7P/4K3/5R2 b - -", "4k3/8/8/8/8/7P/3K4/5R2 b - -", "4k3/8/8/8/8/7P/7R/5K2 b - -", "4k3/8/8/8/8/7P/8/5KR1 b - -", "4k3/8/8/8/8/7P/7R/3K1b2 b - -", "4k3/8/8/8/8/7P/8/3K1bR1 b - -", "4k3/8/8/8/8/7P/8/3K1R2 b - -"});
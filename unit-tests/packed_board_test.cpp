@@ -0,0 +1,22 @@
+#include "../packed_board.hpp"
+#include "test_utils.hpp"
+#include <set>
+int main() {
+	for (const std::string &fen : SAMPLE_FENS) {
+		movelist moves = parse_fen(fen).generate_moves();
+		std::set<board> boards;
+		std::set<packed_board> packed;
+		for (const dice_roll &dice : full_and_partial_dice_rolls) {
+			for (const board &x : moves.get_moves(dice)) {
+				packed_board p = packed_board::pack(x);
+				board y = p.unpack();
+				CHECK_CASE(y == x && y.hash() == x.hash() && y.fen() == x.fen() && packed_board::pack(y) == p, describe(x.fen(), "from", fen, "with", dice));
+				boards.insert(x);
+				packed.insert(p);
+			}
+		}
+		CHECK_CASE(boards.size() == packed.size(), "packed ordering among the moves of " + fen);
+	}
+	ASSERT_EQUAL(packed_board::pack(parse_fen("7k/8/8/8/8/8/8/K7 w - - 0 1")) != packed_board::pack(parse_fen("7k/8/8/8/8/8/8/K7 b - - 0 1")), true);
+	ASSERT_EQUAL(packed_board::pack(parse_fen("7k/8/8/8/8/8/8/K7 w - - 0 1")).hash() != packed_board::pack(parse_fen("7k/8/8/8/8/8/8/K7 b - - 0 1")).hash(), true);
+}
@@ -0,0 +1,33 @@
+#include "../playout_cache.hpp"
+#include "test_utils.hpp"
+#include <algorithm>
+int main() {
+	std::vector<std::string> fens(std::begin(SAMPLE_FENS), std::end(SAMPLE_FENS));
+	fens.push_back("8/8/8/3k4/3K4/8/8/8 w - - 0 1"); //Every roll captures the king
+	playout_cache cache(10, size_t(1) << 30);
+	playout_cache::counters stats;
+	for (const std::string &fen : fens) {
+		const board b = parse_fen(fen);
+		movelist expected = b.generate_moves_lazily();
+		for (int pass = 0; pass < 2; ++pass) {
+			const uint64_t captures = cache.king_captures(b, stats);
+			std::shared_ptr<const compact_movelist> moves = cache.moves(b, stats);
+			for (size_t i = 0; i < full_dice_rolls.size(); ++i) {
+				const move_range &roll_moves = expected.get_moves(full_dice_rolls[i]);
+				std::span<const board> cached = moves->get_moves(full_dice_rolls[i]);
+				CHECK_CASE((captures >> i & 1) == roll_moves.empty(), describe(fen, "with", full_dice_rolls[i], "pass", pass));
+				CHECK_CASE(cached.size() == roll_moves.size() && std::equal(cached.begin(), cached.end(), roll_moves.begin()), describe(fen, "with", full_dice_rolls[i], "pass", pass));
+			}
+		}
+	}
+	ASSERT_EQUAL(stats.lookups, 2 * (long long)fens.size());
+	ASSERT_EQUAL(stats.hits, (long long)fens.size());
+	ASSERT_EQUAL(stats.moves_hits, (long long)fens.size());
+
+	playout_cache disabled(0, 0);
+	playout_cache::counters disabled_stats;
+	const board start = parse_fen(SAMPLE_FENS[0]);
+	ASSERT_EQUAL(disabled.king_captures(start, disabled_stats), full_king_capture_rolls(start));
+	ASSERT_EQUAL(disabled.moves(start, disabled_stats) == nullptr, true);
+	ASSERT_EQUAL(disabled_stats.lookups, 0LL);
+}
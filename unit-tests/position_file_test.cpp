@@ -0,0 +1,83 @@
+#include "../position_file.hpp"
+#include "test_utils.hpp"
+#include <cstdio>
+#include <vector>
+int main() {
+	const std::string path = "position_file_test.pos", annotated_path = "position_file_test_annotated.pos", bad_path = "position_file_test_bad.pos";
+	std::vector<board> boards;
+	movelist moves = parse_fen("r3k2r/ppp2ppp/2n1bn2/3pp3/3PP3/2N1BN2/PPP2PPP/R3K2R w KQkq - 0 1").generate_moves();
+	for (const dice_roll &dice : full_dice_rolls) boards.insert(boards.end(), moves.get_moves(dice).begin(), moves.get_moves(dice).end());
+	{
+		position_file_writer plain(path, false), annotated(annotated_path, true);
+		for (size_t i = 0; i < boards.size(); ++i) {
+			position_annotation annotation;
+			annotation.evaluation = i / 2.0f;
+			annotation.winning_rolls = i % OMEGA;
+			annotation.moves[i % annotation.moves.size()] = i;
+			plain.write(boards[i], annotation);
+			annotated.write(boards[i], annotation);
+		}
+		ASSERT_EQUAL(plain.close() && annotated.close(), true);
+	}
+	std::string error;
+	std::optional<position_file_reader> plain = position_file_reader::open(path, error), annotated = position_file_reader::open(annotated_path, error);
+	ASSERT_EQUAL(plain.has_value() && annotated.has_value(), true);
+	ASSERT_EQUAL(position_file_reader::is_position_file(path), true);
+	ASSERT_EQUAL(plain->size(), boards.size());
+	ASSERT_EQUAL(annotated->size(), boards.size());
+	ASSERT_EQUAL(plain->annotated(), false);
+	ASSERT_EQUAL(annotated->annotated(), true);
+	for (size_t i = 0; i < boards.size(); ++i) {
+		std::optional<board> from_plain = plain->position(i), from_annotated = annotated->position(i);
+		CHECK_CASE(from_plain && from_annotated && *from_plain == boards[i] && *from_annotated == boards[i] && from_plain->hash() == boards[i].hash(), describe(boards[i].fen(), "record", i));
+		const position_annotation *annotation = annotated->annotation(i);
+		CHECK_CASE(!plain->annotation(i) && annotation->evaluation == i / 2.0f && annotation->winning_rolls == i % OMEGA && annotation->moves[i % annotation->moves.size()] == i, describe("annotation of record", i));
+	}
+
+	FILE *bad = fopen(bad_path.c_str(), "wb");
+	fputs("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1\n", bad);
+	fclose(bad);
+	ASSERT_EQUAL(position_file_reader::is_position_file(bad_path), false);
+	ASSERT_EQUAL(position_file_reader::open(bad_path, error).has_value(), false);
+	position_file_header header;
+	header.version = position_file_header::VERSION + 1;
+	header.record_size = sizeof(packed_board);
+	bad = fopen(bad_path.c_str(), "wb");
+	fwrite(&header, sizeof(header), 1, bad);
+	fclose(bad);
+	ASSERT_EQUAL(position_file_reader::open(bad_path, error).has_value(), false);
+	ASSERT_EQUAL(position_file_reader::open("no_such_file.pos", error).has_value(), false);
+	header.version = position_file_header::VERSION;
+	packed_board valid = packed_board::pack(boards[0]), bad_nibble = valid, too_many = valid, bad_castling = valid;
+	bad_nibble.pieces[0] |= 15;
+	too_many.occupancy = ~bitboard(0);
+	bad_castling.castling_mask = 16;
+	packed_board rookless = packed_board::pack(parse_fen("4k3/8/8/8/8/8/8/4K3 w - - 0 1")), no_black_king = rookless;
+	rookless.castling_mask = WHITE_KINGSIDE_CASTLE; //Pack and unpack fine, but check_position() rejects them
+	no_black_king.pieces[0] = make_piece(KING, WHITE) | make_piece(QUEEN, BLACK) << 4;
+	const packed_board records[] = {valid, bad_nibble, too_many, bad_castling, rookless, no_black_king};
+	header.count = std::size(records);
+	bad = fopen(bad_path.c_str(), "wb");
+	fwrite(&header, sizeof(header), 1, bad);
+	fwrite(records, sizeof(records), 1, bad);
+	fclose(bad);
+	std::optional<position_file_reader> corrupt = position_file_reader::open(bad_path, error); //Records are only checked when read
+	ASSERT_EQUAL(corrupt.has_value(), true);
+	ASSERT_EQUAL(corrupt->position(0).has_value(), true);
+	for (size_t i = 1; i < corrupt->size(); ++i) CHECK_CASE(!corrupt->position(i), describe("corrupt record", i));
+	corrupt.reset();
+	{
+		position_file_writer rejecting(bad_path, false);
+		ASSERT_EQUAL(rejecting.write(rookless.unpack()), false);
+		ASSERT_EQUAL(rejecting.write(boards[0]) && rejecting.close(), true);
+	}
+	ASSERT_EQUAL(position_file_reader::open(bad_path, error)->size(), size_t(1));
+	position_file_writer full("/dev/full", false); //Every write fails with ENOSPC, at the latest when flushing
+	if (full.is_open()) {
+		full.write(boards[0]);
+		ASSERT_EQUAL(full.close(), false);
+	}
+	remove(path.c_str());
+	remove(annotated_path.c_str());
+	remove(bad_path.c_str());
+}
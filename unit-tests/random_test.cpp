@@ -0,0 +1,42 @@
+#include "../board.hpp"
+#include "test_utils.hpp"
+#include <algorithm>
+#include <cmath>
+int main() {
+	xoshiro256pp reference({1, 2, 3, 4});
+	ASSERT_EQUAL(reference(), uint64_t(41943041)); //rotl(1 + 4, 23) + 1, the first output of the reference implementation
+
+	ASSERT_EQUAL(xoshiro256pp::stream(10, 3)(), xoshiro256pp::stream(10, 3)());
+	ASSERT_EQUAL(xoshiro256pp::stream(10, 0)() == xoshiro256pp::stream(10, 1)(), false);
+	ASSERT_EQUAL(splitmix64_generator::stream(10, 0)() == splitmix64_generator::stream(10, 1)(), false);
+
+	const int SAMPLES = 1 << 20;
+	xoshiro256pp rng(10);
+	int out_of_range = 0;
+	std::vector<int> counts(37);
+	for (int i = 0; i < SAMPLES; ++i) {
+		uint64_t x = random_below(rng, counts.size());
+		if (x >= counts.size()) out_of_range++;
+		else counts[x]++;
+		double unit = random_unit(rng);
+		if (unit < 0 || unit >= 1) out_of_range++;
+	}
+	ASSERT_EQUAL(out_of_range, 0);
+	const double expected = SAMPLES / (double)counts.size();
+	ASSERT_EQUAL(std::all_of(counts.begin(), counts.end(), [&](int x) {return std::abs(x - expected) < 6 * std::sqrt(expected);}), true);
+	ASSERT_EQUAL(random_below(rng, 1), uint64_t(0));
+
+	std::vector<int> per_die(DICE_ROLL_LENGTH), at_once(DICE_ROLL_LENGTH); //Both by encode(), in proportion to combinations()
+	for (int i = 0; i < SAMPLES; ++i) {
+		per_die[dice_roll::roll(rng).encode()]++;
+		at_once[dice_roll::roll_at_once(rng).encode()]++;
+	}
+	int mismatches = 0;
+	for (size_t i = 0; i < DICE_ROLL_LENGTH; ++i) {
+		const dice_roll dice = dice_roll::decode(i);
+		const double expected_rolls = dice.total_rolls() == DICE_COUNT ? SAMPLES * dice.combinations() / (double)OMEGA : 0;
+		for (int count : {per_die[i], at_once[i]})
+			if (std::abs(count - expected_rolls) > 6 * std::sqrt(expected_rolls)) mismatches++;
+	}
+	ASSERT_EQUAL(mismatches, 0);
+}
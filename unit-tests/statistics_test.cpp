@@ -0,0 +1,45 @@
+#include "../statistics.hpp"
+#include "test_utils.hpp"
+#include <vector>
+int main() {
+	std::vector<long double> samples;
+	for (int i = 0; i < 1000; ++i) samples.push_back(1e6 + (i * 37 % 101) / 100.0L); //Big offset, naive sum of squares would lose the variance
+	long double sum = 0, squares = 0;
+	for (long double x : samples) sum += x;
+	long double mean = sum / samples.size();
+	for (long double x : samples) squares += (x - mean) * (x - mean);
+	long double variance = squares / (samples.size() - 1);
+
+	running_statistics all, parts[3];
+	for (size_t i = 0; i < samples.size(); ++i) {
+		all.add(samples[i]);
+		parts[i * i % 3].add(samples[i]);
+	}
+	running_statistics merged;
+	for (const running_statistics &part : parts) merged.merge(part);
+	merged.merge(running_statistics());
+
+	ASSERT_EQUAL(all.count, (long long)samples.size());
+	ASSERT_EQUAL(merged.count, (long long)samples.size());
+	ASSERT_EQUAL(std::abs(all.mean - mean) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(all.variance() - variance) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(merged.mean - mean) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(merged.variance() - variance) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(merged.error() - std::sqrt(variance / samples.size())) < 1e-9, true);
+	ASSERT_EQUAL(running_statistics().error(), 0.0L);
+
+	long double y_mean = 0, products = 0;
+	for (size_t i = 0; i < samples.size(); ++i) y_mean += (i % 7) / (long double)samples.size();
+	for (size_t i = 0; i < samples.size(); ++i) products += (samples[i] - mean) * ((i % 7) - y_mean);
+	running_covariance pairs, pair_parts[3];
+	for (size_t i = 0; i < samples.size(); ++i) {
+		pairs.add(samples[i], i % 7);
+		pair_parts[i * i % 3].add(samples[i], i % 7);
+	}
+	running_covariance pairs_merged;
+	for (const running_covariance &part : pair_parts) pairs_merged.merge(part);
+	ASSERT_EQUAL(pairs.count(), (long long)samples.size());
+	ASSERT_EQUAL(std::abs(pairs.covariance() - products / (samples.size() - 1)) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(pairs_merged.covariance() - products / (samples.size() - 1)) < 1e-9, true);
+	ASSERT_EQUAL(std::abs(pairs_merged.y.mean - y_mean) < 1e-9, true);
+}
@@ -0,0 +1,42 @@
+#include "../symmetric_cache.hpp"
+#include "test_utils.hpp"
+#include <algorithm>
+#include <vector>
+std::vector<board> symmetric_images(const board &b) { //All the positions canonical() considers equivalent to b
+	std::vector<board> ret = {b, b.flip()};
+	if (!b.get_castling_mask()) {
+		board mirrored = b;
+		mirrored.flip_horizontally_in_place();
+		ret.push_back(mirrored);
+		ret.push_back(mirrored.flip());
+	}
+	return ret;
+}
+int main() {
+	std::vector<std::string> fens(std::begin(SAMPLE_FENS), std::end(SAMPLE_FENS));
+	fens.push_back("r3k2r/ppp2ppp/2n1bn2/3pp3/3PP3/2N1BN2/PPP2PPP/R3K2R b Kq - 0 1"); //Castling rights that aren't colour symmetric
+	fens.push_back("4k3/8/8/3r4/8/8/8/2R1K3 w - - 0 1");
+	int builds = 0;
+	symmetric_cache<roll_results> cache(1 << 10);
+	for (const std::string &fen : fens) {
+		const board b = parse_fen(fen), canonical = b.canonical();
+		const roll_results expected = roll_results::of(b);
+		std::vector<board> images = symmetric_images(b);
+		CHECK_CASE(std::find(images.begin(), images.end(), canonical) != images.end(), "canonical form of " + fen);
+		CHECK_CASE(canonical.hash() == parse_fen(canonical.fen()).hash(), "canonical form of " + fen);
+		for (const board &image : images) {
+			const roll_results cached = cache.get(image, [&]{builds++; return roll_results::of(image);}), direct = roll_results::of(image);
+			CHECK_CASE(image.canonical() == canonical && !(image < canonical), describe(image.fen(), "image of", fen));
+			CHECK_CASE(direct.winning_rolls == expected.winning_rolls && direct.moves == expected.moves && direct.distinct_positions == expected.distinct_positions, describe(image.fen(), "image of", fen));
+			CHECK_CASE(cached.winning_rolls == expected.winning_rolls && cached.moves == expected.moves && cached.distinct_positions == expected.distinct_positions, describe("cached", image.fen(), "image of", fen));
+		}
+	}
+	ASSERT_EQUAL(builds, (int)fens.size()); //One per symmetry class, the other images are hits
+	const board castling = parse_fen("r3k2r/ppp2ppp/2n1bn2/3pp3/3PP3/2N1BN2/PPP2PPP/R3K2R b Kq - 0 1");
+	ASSERT_EQUAL(castling.canonical() == castling || castling.canonical() == castling.flip(), true); //Mirroring would swap the castling sides
+
+	symmetric_cache<int> disabled(0);
+	int computed = 0;
+	for (int i = 0; i < 3; ++i) disabled.get(castling, [&]{return ++computed;});
+	ASSERT_EQUAL(computed, 3);
+}
@@ -0,0 +1,58 @@
+#include "../tablebase.hpp"
+#include "../expectimax.hpp"
+#include "test_utils.hpp"
+#include <cmath>
+int main() {
+	ASSERT_EQUAL(tablebase::parse_material("KRvK").has_value(), true);
+	ASSERT_EQUAL(tablebase::material_name(*tablebase::parse_material("KRvKN")), std::string("KRvKN"));
+	ASSERT_EQUAL(tablebase::parse_material("KPvK").has_value(), false);
+	ASSERT_EQUAL(tablebase::parse_material("KRRRvK").has_value(), false);
+	ASSERT_EQUAL(tablebase::parse_material("RvK").has_value(), false);
+
+	tablebase tables;
+	tablebase_generation_options options;
+	options.tolerance = 1e-7;
+	tables.generate(*tablebase::parse_material("KvK"), options);
+	ASSERT_EQUAL(tables.contains(*tablebase::parse_material("KvK")), true);
+
+	std::optional<tablebase::value> adjacent = tables.probe(parse_fen(ADJACENT_KINGS_FEN));
+	ASSERT_EQUAL(adjacent.has_value(), true);
+	ASSERT_EQUAL(std::abs(adjacent->win - adjacent_kings(-1).won) < 1e-4, true);
+	ASSERT_EQUAL(std::abs(adjacent->loss - adjacent_kings(-1).lost) < 1e-4, true);
+
+	for (const char *fen : {"8/8/8/3k4/3K4/8/8/8 b - - 0 1", "k7/8/8/8/8/8/8/7K w - - 0 1", "8/8/2k5/8/2K5/8/8/8 b - - 0 1", "K7/8/1k6/8/8/8/8/8 w - - 0 1"}) {
+		board b = parse_fen(fen);
+		std::optional<tablebase::value> v = tables.probe(b), flipped = tables.probe(b.flip());
+		if (!CHECK_CASE(v && flipped, fen)) continue;
+		CHECK_CASE(v->win == flipped->win && v->loss == flipped->loss && v->win + v->loss <= 1 + 1e-4, describe(fen, "has", v->win, v->loss, "flipped", flipped->win, flipped->loss));
+	}
+	ASSERT_EQUAL(tables.probe(parse_fen("8/8/8/3k4/3K4/8/8/R7 w - - 0 1")).has_value(), false);
+	ASSERT_EQUAL(tables.probe(parse_fen("8/8/8/3k4/3K4/8/P7/8 w - - 0 1")).has_value(), false);
+
+	const std::string path = "tablebase_test.tb";
+	ASSERT_EQUAL(tables.save(path), true);
+	std::string error;
+	std::optional<tablebase> loaded = tablebase::load(path, error);
+	ASSERT_EQUAL(loaded.has_value(), true);
+	ASSERT_EQUAL(loaded->probe(parse_fen(ADJACENT_KINGS_FEN))->win, adjacent->win);
+	remove(path.c_str());
+	ASSERT_EQUAL(tablebase::load(path, error).has_value(), false);
+
+	expectimax_search engine(10);
+	engine.use_tablebase(&tables);
+	expectimax_search::result r = engine.search(parse_fen(ADJACENT_KINGS_FEN), std::chrono::milliseconds(1000), 2);
+	ASSERT_EQUAL(std::abs(r.value - adjacent->score()) < 1e-6, true);
+
+	//Every KvK position must satisfy the equation it was iterated on, also when only part of the successors fit the cache.
+	//Three piece tables take tens of seconds to generate, they are checked by generate-tablebase --check instead.
+	ASSERT_EQUAL(*tables.max_residual(*tablebase::parse_material("KvK"), SIZE_MAX) < 1e-4, true);
+	tablebase partly_cached;
+	options.tolerance = 1e-3;
+	options.successor_cache_bytes = 1 << 19; //About half of KvK
+	partly_cached.generate(*tablebase::parse_material("KvK"), options);
+	ASSERT_EQUAL(*partly_cached.max_residual(*tablebase::parse_material("KvK"), 1000) < 1e-3 + 1e-4, true);
+	tablebase unconverged;
+	options.max_iterations = 1;
+	unconverged.generate(*tablebase::parse_material("KvK"), options);
+	ASSERT_EQUAL(*unconverged.max_residual(*tablebase::parse_material("KvK"), 1000) > 1e-2, true);
+}
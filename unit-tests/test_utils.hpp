@@ -3,7 +3,9 @@
 #define ASSERT_EQUAL(a, b) assert_equal_impl(__LINE__, a, b, #a, #b)
 #define ASSERT_THROWS(e, f) assert_throws_impl<e>(__LINE__, []{f;}, #f, #e)
 #define ASSERT_THROWS_WITH_CONTENT(e, f, field, field_value) assert_throws_with_content_impl<e>(__LINE__, []{f;}, #f, #field, #e, [](const auto &__x){return __x.field;}, field_value)
+#define CHECK_CASE(condition, context) check_case_impl(__LINE__, (condition), #condition, [&]{return std::string(context);})
 #include <iostream>
+#include <sstream>
 #include <string>
 #include "../output_operators.hpp"
 inline int count_failed = false;
@@ -18,6 +20,45 @@ template <class c> void assert_equal_impl(int line, c a, c b, const std::string
 		std::cout << GREEN << "PASSED IN LINE " << line << ": " << a_name << " = " << b_name << CLEAR_COLOURS << std::endl;
 	}
 }
+/// For checks repeated over many generated positions: silent when condition holds, otherwise reports context (built only then), typically the FEN and dice of the failing case
+template <class F> bool check_case_impl(int line, bool condition, const std::string &condition_text, F &&context) {
+	if (!condition) {
+		std::cout << RED << "ERROR IN LINE " << line << ": " << condition_text << " failed for " << context() << CLEAR_COLOURS << std::endl;
+		mark_test_failure();
+	}
+	return condition;
+}
+/// Space separated parts, to build CHECK_CASE contexts like describe(fen, "with", dice)
+template <class... T> std::string describe(const T &...parts) {
+	std::stringstream ret;
+	((ret << parts << ' '), ...);
+	std::string text = ret.str();
+	text.pop_back();
+	return text;
+}
+/// Positions the tests walking all generated moves start from: the start position, castling on both sides, several en passant squares, a promotion and an en passant capture
+inline const std::string SAMPLE_FENS[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/ppp2ppp/2n1bn2/3pp3/3PP3/2N1BN2/PPP2PPP/R3K2R b KQkq - 0 1",
+	"K6k/8/8/8/PpPpP3/8/8/8 b - a3,c3,e3 0 1",
+	"7k/PN6/8/8/8/8/8/K7 w - - 0 1",
+	"7k/8/4n3/3PpP2/8/8/8/7K w - e6 0 1",
+};
+/// Kings side by side: the 91 of the 216 (OMEGA) rolls with a king capture, the other 125 can't move at all and pass the same situation to the opponent
+inline const std::string ADJACENT_KINGS_FEN = "8/8/8/3k4/3K4/8/8/8 w - - 0 1";
+struct adjacent_kings_outcome {
+	double won = 0, lost = 0, still_playing = 1; ///< For the side to move
+};
+inline adjacent_kings_outcome adjacent_kings(int plies) { ///< After plies, or in the limit for plies < 0
+	const double capture = 91.0 / 216, pass = 125.0 / 216;
+	if (plies < 0) return {capture / (1 - pass * pass), pass * capture / (1 - pass * pass), 0};
+	adjacent_kings_outcome ret;
+	for (int ply = 0; ply < plies; ++ply) {
+		(ply % 2 ? ret.lost : ret.won) += ret.still_playing * capture;
+		ret.still_playing *= pass;
+	}
+	return ret;
+}
 template <class Exception, class F> void assert_throws_impl(int line, F f, const std::string &command, const std::string &exception_name) {
 	try {
 		f();
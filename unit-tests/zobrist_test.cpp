@@ -0,0 +1,23 @@
+#include "../board.hpp"
+#include "test_utils.hpp"
+#include <set>
+int main() {
+	for (const std::string &fen : SAMPLE_FENS) {
+		board b = parse_fen(fen);
+		ASSERT_EQUAL(b.flip().flip().hash(), b.hash());
+		movelist moves = b.generate_moves();
+		std::set<board> boards;
+		std::set<hash_type> hashes;
+		for (const dice_roll &dice : full_and_partial_dice_rolls) {
+			for (const board &x : moves.get_moves(dice)) {
+				CHECK_CASE(x.hash() == parse_fen(x.fen()).hash(), x.fen() + " from " + fen);
+				CHECK_CASE(x.flip().hash() == parse_fen(x.flip().fen()).hash(), x.flip().fen() + " from " + fen);
+				boards.insert(x);
+				hashes.insert(x.hash());
+			}
+		}
+		CHECK_CASE(boards.size() == hashes.size(), "hash collision among the moves of " + fen);
+	}
+	ASSERT_EQUAL(parse_fen("7k/8/8/8/8/8/8/K7 w - - 0 1").hash() != parse_fen("7k/8/8/8/8/8/8/K7 b - - 0 1").hash(), true);
+	ASSERT_EQUAL(parse_fen("r3k3/8/8/8/8/8/8/4K3 w q - 0 1").hash() != parse_fen("r3k3/8/8/8/8/8/8/4K3 w - - 0 1").hash(), true);
+}
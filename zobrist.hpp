@@ -0,0 +1,29 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+#include <array>
+#include "board.hpp"
+#include "splitmix.hpp"
+
+struct zobrist_keys {
+	std::array<std::array<hash_type, BOARD_WIDTH * BOARD_HEIGHT>, KING + 2> piece_square; /// <Indexed by square value (piece | player) and square_index
+	std::array<hash_type, 1 << 4> castling; /// <Indexed by the whole castling mask
+	std::array<hash_type, 1 << BOARD_WIDTH> en_passant; /// <Indexed by the whole en passant mask
+	hash_type black_to_move;
+};
+
+consteval zobrist_keys make_zobrist_keys() {
+	zobrist_keys ret{};
+	uint64_t seed = 0;
+	for (uint8_t piece = PAWN; piece <= KING; piece += 2)
+		for (uint8_t player : {WHITE, BLACK})
+			for (hash_type &key : ret.piece_square[make_piece(piece, player)])
+				key = splitmix64(seed++);
+	for (size_t i = 1; i < ret.castling.size(); ++i) ret.castling[i] = splitmix64(seed++);
+	for (size_t i = 1; i < ret.en_passant.size(); ++i) ret.en_passant[i] = splitmix64(seed++);
+	ret.black_to_move = splitmix64(seed++);
+	return ret;
+}
+
+constexpr zobrist_keys zobrist = make_zobrist_keys();
+
+#endif